@@ -0,0 +1,171 @@
+#!/bin/bash
+#
+# CMPSC311 - LionCloud Device - benchmark suite
+# lcloud_bench.sh - run the standard workloads against the optimized simulator
+#                   and compare the results with the stored baseline (the
+#                   workloads are recorded as binary traces and replayed so
+#                   that workload parsing is not part of the measurement)
+#
+# USAGE: lcloud_bench.sh [-u] [-r]
+#
+#    -u - update the baseline file with the results of this run
+#    -r - regenerate the workloads and traces (they are otherwise generated once and
+#         reused so that successive runs measure identical inputs)
+#
+# Environment:
+#
+#    BENCH_TOLERANCE - allowed change (percent) before a metric is flagged as
+#                      a regression (default 10)
+#    BENCH_RUNS      - runs of each workload, the fastest is reported (default 5)
+#
+
+# Locations
+BENCHDIR=bench
+WORKDIR=$BENCHDIR/work
+BASELINE=$BENCHDIR/baseline.txt
+MANIFEST=cmpsc311-assign3-manifest.txt
+SIMULATOR=./lcloud_sim_bench
+GENERATOR=./lcloud_wlgen
+TOLERANCE=${BENCH_TOLERANCE:-10}
+RUNS=${BENCH_RUNS:-5}
+
+# Standard workloads
+#   name          type          ops    maxop  objs  minsz  maxsz
+WORKLOADS="
+    linear-small   linear        20000  64     16    256    4096
+    linear-large   linear        20000  1024   16    8192   65536
+    random-small   random        20000  64     16    256    4096
+    random-large   random        20000  1024   16    8192   65536
+    locality-small locality:80:8 20000  64     16    256    4096
+    locality-large locality:80:8 20000  1024   16    8192   65536
+"
+
+# Options
+update=0
+regen=0
+while getopts "ur" opt; do
+    case $opt in
+        u) update=1 ;;
+        r) regen=1 ;;
+        *) echo "USAGE: $0 [-u] [-r]" >&2; exit 1 ;;
+    esac
+done
+
+if [ ! -x $SIMULATOR ] || [ ! -x $GENERATOR ]; then
+    echo "Missing $SIMULATOR or $GENERATOR, run 'make bench'" >&2
+    exit 1
+fi
+mkdir -p $WORKDIR
+
+# Pull a numeric field out of the stats JSON (keys are unique in the dump)
+jsonval() {
+    sed -n "s/.*\"$2\": \([0-9.]*\).*/\1/p" $1 | head -1
+}
+
+results=$WORKDIR/results.txt
+printf "# %-14s %12s %14s %10s %8s\n" workload "ops/sec" "bytes/sec" "bus/op" "hitrate" > $results
+failed=0
+
+echo "$WORKLOADS" | while read name type ops maxop objs minsz maxsz; do
+    [ -z "$name" ] && continue
+
+    # Generate the workload (once)
+    wload=$WORKDIR/$name.txt
+    if [ $regen -eq 1 ] || [ ! -f $wload ]; then
+        cat > $WORKDIR/$name.spec <<EOF
+WORKLOAD $name
+WORKLOAD-PARAM overwrite
+WORKLOAD-PARAM type $(echo $type | tr ':' ' ')
+WORKLOAD-PARAM operations $ops $maxop
+OBJECTS random $objs $minsz $maxsz $name
+WORKLOAD-OUTPUT $wload
+GENERATE
+EOF
+        if ! $GENERATOR $WORKDIR/$name.spec 2> $WORKDIR/$name.genlog || [ ! -f $wload ]; then
+            echo "$name: workload generation failed (see $WORKDIR/$name.genlog)" >&2
+            echo "FAILED $name" >> $results
+            continue
+        fi
+    fi
+
+    # Record the binary trace (once per workload)
+    trace=$WORKDIR/$name.trace
+    if [ $regen -eq 1 ] || [ ! -f $trace ] || [ $wload -nt $trace ]; then
+        if ! $SIMULATOR -r $trace $wload 2> $WORKDIR/$name.reclog; then
+            echo "$name: trace recording failed (see $WORKDIR/$name.reclog)" >&2
+            echo "FAILED $name" >> $results
+            continue
+        fi
+    fi
+
+    # Run the workload, collect the counters (keep the fastest run)
+    stats=$WORKDIR/$name.json
+    secs=
+    for run in $(seq $RUNS); do
+        rm -f $stats
+        $SIMULATOR -t -s $stats $MANIFEST $trace 2> $WORKDIR/$name.log
+        if [ ! -f $stats ] || ! grep -q '"status": "completed"' $stats; then
+            secs=FAILED
+            break
+        fi
+        secs=$(awk -v a="$secs" -v b=$(jsonval $stats elapsed_sec) 'BEGIN { print (a == "" || b < a) ? b : a }')
+    done
+    if [ "$secs" = "FAILED" ]; then
+        echo "$name: simulation failed (see $WORKDIR/$name.log)" >&2
+        echo "FAILED $name" >> $results
+        continue
+    fi
+
+    # (hit rate: block reads served from the cache or from delayed slots)
+    awk -v name=$name -v ops=$(jsonval $stats operations) -v bytes=$(jsonval $stats bytes) \
+        -v secs=$secs -v bus=$(jsonval $stats transactions) \
+        -v hit=$(jsonval $stats read_hit_rate) 'BEGIN {
+            if (secs <= 0) secs = 1e-9;
+            printf "  %-14s %12.0f %14.0f %10.3f %8.4f\n", name, ops/secs, bytes/secs, bus/ops, hit
+        }' >> $results
+done
+
+# Report, compare against the baseline
+cat $results
+if grep -q "^FAILED" $results; then
+    failed=1
+fi
+
+if [ $update -eq 1 ]; then
+    if [ $failed -eq 1 ]; then
+        echo "Not updating the baseline, some workloads failed." >&2
+        exit 1
+    fi
+    cp $results $BASELINE
+    echo "Updated baseline $BASELINE"
+    exit 0
+fi
+
+if [ ! -f $BASELINE ]; then
+    echo "No baseline ($BASELINE), run 'make bench-baseline' to create one."
+    exit $failed
+fi
+
+awk -v tol=$TOLERANCE '
+    # higher is better for ops/sec, bytes/sec and hit rate, lower for bus/op
+    function check(wl, metric, base, cur, higher) {
+        if (higher && cur < base * (1 - tol/100.0)) {
+            printf "REGRESSION %-14s %-10s baseline %.4f now %.4f\n", wl, metric, base, cur; bad = 1
+        } else if (!higher && cur > base * (1 + tol/100.0)) {
+            printf "REGRESSION %-14s %-10s baseline %.4f now %.4f\n", wl, metric, base, cur; bad = 1
+        }
+    }
+    /^#/ || /^FAILED/ { next }
+    FNR == NR { bops[$1] = $2; bbytes[$1] = $3; bbus[$1] = $4; bhit[$1] = $5; next }
+    ($1 in bops) {
+        check($1, "ops/sec", bops[$1], $2, 1)
+        check($1, "bytes/sec", bbytes[$1], $3, 1)
+        check($1, "bus/op", bbus[$1], $4, 0)
+        check($1, "hitrate", bhit[$1], $5, 1)
+    }
+    END {
+        if (bad) { exit 1 }
+        printf "No regressions against baseline (tolerance %d%%)\n", tol
+    }' $BASELINE $results || failed=1
+
+exit $failed
@@ -12,39 +12,124 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <cmpsc311_log.h>
 #include <lcloud_cache.h>
 #include <lcloud_controller.h>
 #include <lcloud_filesys.h>
+#include <lcloud_histo.h>
+#include <lcloud_lz.h>
 
-// cache system
-typedef struct cachesys{
-    char cacheblock[LC_DEVICE_BLOCK_SIZE];
-    unsigned int cacheline; 
+// cache line metadata, kept in its own 64-byte aligned array (4 per CPU
+// cache line) apart from the block payloads so lookups do not drag block
+// data through the CPU caches
+typedef struct cachekey{
+    uint64_t lastuse;  // access clock of the last use (smallest is the LRU)
+    uint16_t sec;
+    uint16_t blk;
     LcDeviceId did;
-    int sec;
-    int blk;
-    int howold; // keep track of how old is the cache
+    uint8_t valid;
+    uint16_t reserved;
+}cachekey;
 
+// a cache tier: keys and hash index apart from the payload arena
+typedef struct{
+    cachekey *keys;     // max entries
+    char *arena;        // max payloads, page aligned (line i at i*LC_DEVICE_BLOCK_SIZE)
+    size_t arenasize;   // bytes mapped for the arena
+    int32_t *hash;      // open addressing index: block -> cache line, -1 empty
+    uint32_t hashmask;  // hash slots - 1 (power of 2, at least 2x max)
+}cachetier;
+cachetier l1;          // the in-memory cache (cachesize of maxblock lines)
+cachetier l2;          // victim cache of blocks evicted from l1, in a mapped host file
+const char *l2file = NULL; // L2 host file (NULL if there is no L2)
+int l2blocks;          // L2 capacity
+int l2used;            // L2 lines filled so far (lines below are reused in FIFO order)
+int32_t *l2free;       // L2 lines emptied when their block moved back up
+int nl2free;
+int l2hand;            // next L2 line to replace
+int l2fd = -1;
 
-}cachesys;
-cachesys *cacheinfo;
+// compressed tier between l1 and l2: victims of l1 are kept LZ compressed
+// in a byte ring filled in FIFO order (the oldest entries make room)
+typedef struct{
+    uint32_t off;   // ring offset
+    uint16_t len;   // stored length (LC_DEVICE_BLOCK_SIZE if kept uncompressed)
+}cachespan;
+cachetier zc;          // compressed tier keys and index (arena = the ring)
+cachespan *zspans;     // where each entry is in the ring
+int zbytes = 0;        // ring size (0 if there is no compressed tier)
+int zmaxent;           // entry queue size
+int zhead;             // oldest entry in the queue
+int zcount;            // entries in the queue (including ones moved back up)
+uint32_t ztail;        // next ring offset to fill
+uint64_t cacheclock;   // access clock
 
 // collect cache data
 typedef struct{
     int hits;
     int misses;
     int numaccess;
+    int evictions; // # of items ejected by LRU replacement
+    int prefetches; // # of items loaded ahead of use
+    int inserts; // # of new items inserted
+    int rejected; // # of new items refused admission
+    int l2hits; // # of misses found in L2
+    int l2misses; // # of misses not in L2 either
+    int l2inserts; // # of evicted items moved into L2
+    int l2evictions; // # of items ejected from L2
+    int l2items; // # of L2 items
+    int zhits; // # of misses found in the compressed tier
+    int zinserts; // # of evicted items compressed
+    int zevictions; // # of items ejected from the compressed tier
+    int zitems; // # of compressed items
+    int zstored; // bytes held by compressed items
+    uint64_t zcompressns; // time spent compressing
+    uint64_t zdecompressns; // time spent decompressing
     int bytesused; 
     int numitem; // # of cache items
     int currentLRU;
-    int currentLRUage;
+    uint64_t currentLRUage;
 }cachedata;
 cachedata cdata;
 
 int cachesize; // current cache size
 int maxblock;
+int hugepages = 0; // back the payload arena with huge pages
+
+// TinyLFU admission filter: a count-min sketch of how often each block is
+// looked up, halved every samplesize lookups so old popularity fades
+typedef struct{
+    uint8_t *counts;     // LC_CACHE_SKETCHROWS rows of width counters
+    uint32_t width;      // counters per row (power of 2)
+    uint32_t additions;  // lookups since the last aging
+    uint32_t samplesize; // lookups between agings
+}cachesketch;
+cachesketch sketch;
+int admission = 0; // admission filter enabled
+
+// warm restart snapshot: the key set in recency order (oldest first).  The
+// blocks are read back from the devices, never from the snapshot: the
+// filesystem metadata does not survive the restart, so saved contents could
+// not be trusted to match what the devices hold.
+#define LC_CACHE_SNAPMAGIC "LCCACHE1"
+typedef struct{
+    char magic[8];     // LC_CACHE_SNAPMAGIC
+    uint32_t count;    // number of keys
+    uint32_t flags;    // unused (0)
+}cachesnaphdr;
+typedef struct{
+    uint16_t sec;
+    uint16_t blk;
+    LcDeviceId did;
+    uint8_t pad[3];
+}cachesnapkey;
+const char *snapfile = NULL; // snapshot written at close and loaded at init
+cachesnapkey *snapkeys;      // keys loaded at init still to be prefetched
+int nsnapkeys;
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -57,35 +142,603 @@ int maxblock;
 int findLRU(){
     int i;
 
-    cdata.currentLRUage = cacheinfo[maxblock-1].howold;
-    for(i=maxblock-1; i>0; i--){
-        // find oldest cache item from the end
-        if(cdata.currentLRUage < cacheinfo[i].howold){
-            cdata.currentLRUage = cacheinfo[i].howold; //update current LRU value as oldest time
+    cdata.currentLRU = maxblock-1;
+    cdata.currentLRUage = l1.keys[maxblock-1].lastuse;
+    for(i=maxblock-1; i>=0; i--){
+        // find least recently used cache item from the end
+        if(l1.keys[i].lastuse < cdata.currentLRUage){
+            cdata.currentLRUage = l1.keys[i].lastuse; //update current LRU value as oldest time
             cdata.currentLRU = i;
         }
     }
     return cdata.currentLRU;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sketchslot
+// Description  : counter index of a block in one row of the sketch
+//
+// Inputs       : did, sec, blk - the block
+//                row - sketch row
+// Outputs      : index into sketch.counts
+
+uint32_t sketchslot(LcDeviceId did, uint16_t sec, uint16_t blk, int row){
+    uint64_t h = ((uint64_t)did << 32) | ((uint64_t)sec << 16) | blk;
+
+    // splitmix64 finalizer, seeded per row
+    h += 0x9e3779b97f4a7c15ULL * (row + 1);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return row * sketch.width + (uint32_t)(h & (sketch.width - 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sketchcount
+// Description  : count a lookup of a block, aging the sketch when due
+
+void sketchcount(LcDeviceId did, uint16_t sec, uint16_t blk){
+    uint32_t i, idx;
+
+    for(i=0; i<LC_CACHE_SKETCHROWS; i++){
+        idx = sketchslot(did, sec, blk, i);
+        if(sketch.counts[idx] < 15){
+            sketch.counts[idx]++;
+        }
+    }
+    if(++sketch.additions >= sketch.samplesize){
+        for(i=0; i<LC_CACHE_SKETCHROWS*sketch.width; i++){
+            sketch.counts[i] >>= 1;
+        }
+        sketch.additions = 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sketchestimate
+// Description  : estimated lookup frequency of a block (min over the rows)
+
+int sketchestimate(LcDeviceId did, uint16_t sec, uint16_t blk){
+    int i, est = 15;
+
+    for(i=0; i<LC_CACHE_SKETCHROWS; i++){
+        if(sketch.counts[sketchslot(did, sec, blk, i)] < est){
+            est = sketch.counts[sketchslot(did, sec, blk, i)];
+        }
+    }
+    return est;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashslot
+// Description  : home slot of a block in the hash index
+
+uint32_t hashslot(cachetier *t, LcDeviceId did, uint16_t sec, uint16_t blk){
+    uint32_t h = ((uint32_t)did << 24) ^ ((uint32_t)sec << 10) ^ blk;
+
+    h *= 0x9e3779b1;
+    return (h >> 8) & t->hashmask;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashfind
+// Description  : Search a tier's index for a block
+//
+// Outputs      : cache line index, -1 if not cached
+
+int hashfind(cachetier *t, LcDeviceId did, uint16_t sec, uint16_t blk){
+    uint32_t slot;
+    cachekey *key;
+
+    for(slot=hashslot(t, did, sec, blk); t->hash[slot] != -1; slot=(slot+1) & t->hashmask){
+        key = &t->keys[t->hash[slot]];
+        if(key->did == did && key->sec == sec && key->blk == blk){
+            return t->hash[slot];
+        }
+    }
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashinsert
+// Description  : add a cache line to a tier's index
+
+void hashinsert(cachetier *t, int line){
+    uint32_t slot;
+
+    for(slot=hashslot(t, t->keys[line].did, t->keys[line].sec, t->keys[line].blk);
+        t->hash[slot] != -1; slot=(slot+1) & t->hashmask);
+    t->hash[slot] = line;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashremove
+// Description  : remove a cache line from a tier's index, shifting back the
+//                entries after it so no probe chain is broken
+
+void hashremove(cachetier *t, int line){
+    uint32_t slot, next, home;
+    cachekey *key;
+
+    for(slot=hashslot(t, t->keys[line].did, t->keys[line].sec, t->keys[line].blk);
+        t->hash[slot] != line; slot=(slot+1) & t->hashmask);
+    t->hash[slot] = -1;
+    for(next=(slot+1) & t->hashmask; t->hash[next] != -1; next=(next+1) & t->hashmask){
+        key = &t->keys[t->hash[next]];
+        home = hashslot(t, key->did, key->sec, key->blk);
+        // move the entry back if the hole is between its home and where it is
+        if(((next - home) & t->hashmask) >= ((next - slot) & t->hashmask)){
+            t->hash[slot] = t->hash[next];
+            t->hash[next] = -1;
+            slot = next;
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : findcache
-// Description  : Search the cache, if not there, return NULL
+// Description  : Search the cache index for a block
 //
-// Outputs      : 1 or NULL 
+// Outputs      : cache line index, -1 if not cached
 
 int findcache(LcDeviceId did, uint16_t sec, uint16_t blk){
-    int i;
-    for(i=0; i<cachesize; i++){
-        if(cacheinfo[i].did == did && cacheinfo[i].sec == sec && cacheinfo[i].blk == blk){
-            return 1;
+    return hashfind(&l1, did, sec, blk);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : snaporder
+// Description  : qsort comparison of cache lines by last use (oldest first)
+
+int snaporder(const void *a, const void *b){
+    uint64_t x = l1.keys[*(const int *)a].lastuse, y = l1.keys[*(const int *)b].lastuse;
+
+    return (x > y) - (x < y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : savesnapshot
+// Description  : write the cached key set, least recently used first, to
+//                the snapshot file
+//
+// Outputs      : 0 if successful, -1 if failure
+
+int savesnapshot(void){
+    FILE *fhandle;
+    cachesnaphdr hdr;
+    cachesnapkey key;
+    int *order, i, n, ret = 0;
+
+    if((order = (int *)malloc(sizeof(int) * (cachesize + 1))) == NULL ||
+       (fhandle = fopen(snapfile, "w")) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failure opening cache snapshot [%s]", snapfile);
+        free(order);
+        return( -1 );
+    }
+    for(i=0, n=0; i<cachesize; i++){
+        if(l1.keys[i].valid){
+            order[n++] = i;
+        }
+    }
+    qsort(order, n, sizeof(int), snaporder);
+
+    memset(&hdr, 0x0, sizeof(hdr));
+    memcpy(hdr.magic, LC_CACHE_SNAPMAGIC, sizeof(hdr.magic));
+    hdr.count = n;
+    if(fwrite(&hdr, sizeof(hdr), 1, fhandle) != 1){
+        ret = -1;
+    }
+    memset(&key, 0x0, sizeof(key));
+    for(i=0; i<n && ret == 0; i++){
+        key.did = l1.keys[order[i]].did;
+        key.sec = l1.keys[order[i]].sec;
+        key.blk = l1.keys[order[i]].blk;
+        if(fwrite(&key, sizeof(key), 1, fhandle) != 1){
+            ret = -1;
+        }
+    }
+    if(fclose(fhandle) || ret){
+        logMessage(LOG_ERROR_LEVEL, "Failure writing cache snapshot [%s]", snapfile);
+        ret = -1;
+    }
+    else{
+        logMessage(LOG_INFO_LEVEL, "Saved cache snapshot [%s] (%d blocks)", snapfile, n);
+    }
+    free(order);
+    return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : loadsnapshot
+// Description  : read the snapshot file's keys into snapkeys for
+//                lcloud_cacheprefetch.  Only the most recent maxblock keys
+//                are kept.
+//
+// Outputs      : 0 if successful (or there is no snapshot), -1 if failure
+
+int loadsnapshot(void){
+    FILE *fhandle;
+    cachesnaphdr hdr;
+    int skip;
+
+    if((fhandle = fopen(snapfile, "r")) == NULL){
+        logMessage(LOG_INFO_LEVEL, "No cache snapshot [%s], starting cold", snapfile);
+        return( 0 );
+    }
+    if(fread(&hdr, sizeof(hdr), 1, fhandle) != 1 || memcmp(hdr.magic, LC_CACHE_SNAPMAGIC, sizeof(hdr.magic)) ||
+       (snapkeys = (cachesnapkey *)malloc(sizeof(cachesnapkey) * (hdr.count + 1))) == NULL ||
+       fread(snapkeys, sizeof(cachesnapkey), hdr.count, fhandle) != hdr.count){
+        logMessage(LOG_ERROR_LEVEL, "Bad cache snapshot [%s], starting cold", snapfile);
+        fclose(fhandle);
+        free(snapkeys);
+        snapkeys = NULL;
+        return( -1 );
+    }
+    skip = (hdr.count > (uint32_t)maxblock) ? hdr.count - maxblock : 0;
+
+    // keep the most recent keys to prefetch from the devices (any block
+    // contents an older snapshot carries after the keys are ignored)
+    memmove(snapkeys, &snapkeys[skip], sizeof(cachesnapkey) * (hdr.count - skip));
+    nsnapkeys = hdr.count - skip;
+    fclose(fhandle);
+    logMessage(LOG_INFO_LEVEL, "Loaded cache snapshot [%s] (%d blocks to prefetch)", snapfile, nsnapkeys);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : l2put
+// Description  : move a block evicted from the cache into the L2 victim cache,
+//                filling emptied lines first, then replacing in FIFO order
+
+void l2put(LcDeviceId did, uint16_t sec, uint16_t blk, const char *block){
+    int line;
+
+    if(l2file == NULL){
+        return;
+    }
+    if((line = hashfind(&l2, did, sec, blk)) == -1){
+        if(nl2free > 0){
+            line = l2free[--nl2free];
         }
+        else if(l2used < l2blocks){
+            line = l2used++;
+        }
+        else{
+            line = l2hand;
+            l2hand = (l2hand + 1) % l2blocks;
+            if(l2.keys[line].valid){
+                hashremove(&l2, line);
+                cdata.l2evictions++;
+                cdata.l2items--;
+            }
+        }
+        l2.keys[line].did = did;
+        l2.keys[line].sec = sec;
+        l2.keys[line].blk = blk;
+        l2.keys[line].valid = 1;
+        hashinsert(&l2, line);
+        cdata.l2items++;
     }
+    l2.keys[line].lastuse = cacheclock;
+    memcpy(&l2.arena[(size_t)line * LC_DEVICE_BLOCK_SIZE], block, LC_DEVICE_BLOCK_SIZE);
+    cdata.l2inserts++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : l2take
+// Description  : remove a block from the L2 victim cache, copying it to block
+//                first if block is not NULL (the tiers never hold the same
+//                block twice)
+//
+// Outputs      : 0 if the block was in L2, -1 if not
+
+int l2take(LcDeviceId did, uint16_t sec, uint16_t blk, char *block){
+    int line;
 
+    if(l2file == NULL || (line = hashfind(&l2, did, sec, blk)) == -1){
+        return -1;
+    }
+    if(block != NULL){
+        memcpy(block, &l2.arena[(size_t)line * LC_DEVICE_BLOCK_SIZE], LC_DEVICE_BLOCK_SIZE);
+    }
+    hashremove(&l2, line);
+    l2.keys[line].valid = 0;
+    cdata.l2items--;
+    l2free[nl2free++] = line;
     return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : zevict
+// Description  : drop the oldest entry of the compressed tier, moving its
+//                block on to L2
+
+void zevict(void){
+    char block[LC_DEVICE_BLOCK_SIZE];
+    cachekey *key = &zc.keys[zhead];
+    cachespan *span = &zspans[zhead];
+
+    if(key->valid){
+        if(span->len == LC_DEVICE_BLOCK_SIZE){
+            memcpy(block, &zc.arena[span->off], LC_DEVICE_BLOCK_SIZE);
+        }
+        else{
+            lclz_decompress(&zc.arena[span->off], span->len, block, LC_DEVICE_BLOCK_SIZE);
+        }
+        l2put(key->did, key->sec, key->blk, block);
+        hashremove(&zc, zhead);
+        key->valid = 0;
+        cdata.zevictions++;
+        cdata.zitems--;
+        cdata.zstored -= span->len;
+    }
+    zhead = (zhead + 1) % zmaxent;
+    zcount--;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : zput
+// Description  : compress a block evicted from the cache into the compressed
+//                tier (straight to L2 if there is none)
+
+void zput(LcDeviceId did, uint16_t sec, uint16_t blk, const char *block){
+    char packed[LC_DEVICE_BLOCK_SIZE];
+    const char *data = packed;
+    uint64_t tstart = lchist_now();
+    uint32_t head, off;
+    int len, line;
+
+    if(zbytes == 0){
+        l2put(did, sec, blk, block);
+        return;
+    }
+
+    // keep it uncompressed if compression does not save anything
+    if((len = lclz_compress(block, LC_DEVICE_BLOCK_SIZE, packed, LC_DEVICE_BLOCK_SIZE-1)) == -1){
+        len = LC_DEVICE_BLOCK_SIZE;
+        data = block;
+    }
+    cdata.zcompressns += lchist_now() - tstart;
+
+    // find len bytes after the newest entry, dropping the oldest until they fit
+    for(;;){
+        if(zcount == 0){
+            off = ztail = 0;
+            break;
+        }
+        if(zcount < zmaxent){
+            head = zspans[zhead].off;
+            if(ztail > head){
+                if(ztail + len <= (uint32_t)zbytes){
+                    off = ztail;
+                    break;
+                }
+                if((uint32_t)len <= head){
+                    off = 0;  // wrap, the end of the ring stays unused this lap
+                    break;
+                }
+            }
+            else if(ztail + len <= head){
+                off = ztail;
+                break;
+            }
+        }
+        zevict();
+    }
+
+    line = (zhead + zcount) % zmaxent;
+    zcount++;
+    zc.keys[line].did = did;
+    zc.keys[line].sec = sec;
+    zc.keys[line].blk = blk;
+    zc.keys[line].valid = 1;
+    zc.keys[line].lastuse = cacheclock;
+    hashinsert(&zc, line);
+    zspans[line].off = off;
+    zspans[line].len = len;
+    memcpy(&zc.arena[off], data, len);
+    ztail = off + len;
+    cdata.zinserts++;
+    cdata.zitems++;
+    cdata.zstored += len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : ztake
+// Description  : remove a block from the compressed tier, decompressing it to
+//                block first if block is not NULL
+//
+// Outputs      : 0 if the block was in the compressed tier, -1 if not (or
+//                it could not be decompressed)
+
+int ztake(LcDeviceId did, uint16_t sec, uint16_t blk, char *block){
+    uint64_t tstart;
+    cachespan *span;
+    int line, ret = 0;
+
+    if(zbytes == 0 || (line = hashfind(&zc, did, sec, blk)) == -1){
+        return -1;
+    }
+    span = &zspans[line];
+    if(block != NULL){
+        tstart = lchist_now();
+        if(span->len == LC_DEVICE_BLOCK_SIZE){
+            memcpy(block, &zc.arena[span->off], LC_DEVICE_BLOCK_SIZE);
+        }
+        else if(lclz_decompress(&zc.arena[span->off], span->len, block, LC_DEVICE_BLOCK_SIZE) != LC_DEVICE_BLOCK_SIZE){
+            logMessage(LOG_ERROR_LEVEL, "Corrupt compressed cache item (%d/%d/%d)", did, sec, blk);
+            ret = -1;
+        }
+        cdata.zdecompressns += lchist_now() - tstart;
+    }
+
+    // its ring space is reclaimed when the entry reaches the head
+    hashremove(&zc, line);
+    zc.keys[line].valid = 0;
+    cdata.zitems--;
+    cdata.zstored -= span->len;
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : insertblock
+// Description  : put a new block in the cache, replacing the victim line (its
+//                block moves down a tier, unless the line was invalidated) or
+//                appending if victim is -1
+//
+// Outputs      : cache line of the block
+
+int insertblock(LcDeviceId did, uint16_t sec, uint16_t blk, const char *block, int victim){
+    int line = victim;
+
+    cdata.inserts++;
+    if(victim != -1 && l1.keys[victim].valid){
+        cdata.evictions++;
+        zput(l1.keys[victim].did, l1.keys[victim].sec, l1.keys[victim].blk, &l1.arena[(size_t)victim * LC_DEVICE_BLOCK_SIZE]);
+        hashremove(&l1, victim);
+        logMessage(LOG_INFO_LEVEL, "Ejecting cache item index %d, length %d", victim, LC_DEVICE_BLOCK_SIZE);
+    }
+    else if(victim != -1){
+        cdata.numitem += 1; // reusing an invalidated line
+    }
+    else{
+        line = cachesize++;
+        cdata.numitem += 1; // increment the number of cache item
+        cdata.bytesused += LC_DEVICE_BLOCK_SIZE;
+    }
+
+    // set inserting cache info
+    l1.keys[line].did = did;
+    l1.keys[line].sec = sec;
+    l1.keys[line].blk = blk;
+    l1.keys[line].valid = 1;
+    l1.keys[line].lastuse = ++cacheclock; // fresh cache
+    hashinsert(&l1, line);
+    memcpy(&l1.arena[(size_t)line * LC_DEVICE_BLOCK_SIZE], block, LC_DEVICE_BLOCK_SIZE); //put data into the cache
+
+    logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cdata.numitem, cdata.bytesused);
+    logMessage(LOG_INFO_LEVEL, "Added cache item index %d, length %d", line, LC_DEVICE_BLOCK_SIZE);
+    logMessage(LOG_INFO_LEVEL, "LionCloud Cache success inserting cache item (%d/%d/%d) index= %d", did, sec, blk, line);
+    return line;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : l2open
+// Description  : create the (empty) L2 victim cache: the payloads live in the
+//                host file l2file, mapped shared so the kernel can write them
+//                back instead of holding them in RAM
+//
+// Outputs      : 0 if successful, -1 if failure
+
+int l2open(void){
+    uint32_t hashslots;
+
+    l2.arenasize = (size_t)l2blocks * LC_DEVICE_BLOCK_SIZE;
+    for(hashslots=16; hashslots < 2*(uint32_t)l2blocks; hashslots <<= 1);
+    l2.hashmask = hashslots - 1;
+    if((l2fd = open(l2file, O_RDWR|O_CREAT, 0600)) == -1 || ftruncate(l2fd, l2.arenasize) == -1 ||
+       (l2.arena = mmap(NULL, l2.arenasize, PROT_READ|PROT_WRITE, MAP_SHARED, l2fd, 0)) == MAP_FAILED){
+        logMessage(LOG_ERROR_LEVEL, "Failed to map L2 cache file [%s] (%lu bytes)", l2file, l2.arenasize);
+        if(l2fd != -1){
+            close(l2fd);
+        }
+        l2fd = -1;
+        l2.arena = NULL;
+        return( -1 );
+    }
+    if(posix_memalign((void **)&l2.keys, 64, sizeof(cachekey) * l2blocks) != 0 ||
+       (l2.hash = (int32_t *)malloc(sizeof(int32_t) * hashslots)) == NULL ||
+       (l2free = (int32_t *)malloc(sizeof(int32_t) * l2blocks)) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate L2 cache metadata for %d blocks", l2blocks);
+        return( -1 );
+    }
+    memset(l2.keys, 0x0, sizeof(cachekey) * l2blocks);
+    memset(l2.hash, 0xff, sizeof(int32_t) * hashslots);
+    l2used = 0;
+    l2hand = 0;
+    nl2free = 0;
+    logMessage(LOG_INFO_LEVEL, "L2 cache file [%s] mapped for %d blocks", l2file, l2blocks);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : l2close
+// Description  : release the L2 victim cache (its contents are not kept)
+
+void l2close(void){
+    if(l2.arena != NULL){
+        munmap(l2.arena, l2.arenasize);
+        close(l2fd);
+    }
+    free(l2.keys);
+    free(l2.hash);
+    free(l2free);
+    l2free = NULL;
+    nl2free = 0;
+    memset(&l2, 0x0, sizeof(l2));
+    l2fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : zopen
+// Description  : create the (empty) compressed tier of zbytes bytes
+//
+// Outputs      : 0 if successful, -1 if failure
+
+int zopen(void){
+    uint32_t hashslots;
+
+    zmaxent = zbytes / LC_CACHE_ZMINSIZE;
+    for(hashslots=16; hashslots < 2*(uint32_t)zmaxent; hashslots <<= 1);
+    zc.hashmask = hashslots - 1;
+    zc.arenasize = zbytes;
+    if((zc.arena = (char *)malloc(zbytes)) == NULL ||
+       posix_memalign((void **)&zc.keys, 64, sizeof(cachekey) * zmaxent) != 0 ||
+       (zc.hash = (int32_t *)malloc(sizeof(int32_t) * hashslots)) == NULL ||
+       (zspans = (cachespan *)malloc(sizeof(cachespan) * zmaxent)) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate compressed cache tier (%d bytes)", zbytes);
+        return( -1 );
+    }
+    memset(zc.keys, 0x0, sizeof(cachekey) * zmaxent);
+    memset(zc.hash, 0xff, sizeof(int32_t) * hashslots);
+    zhead = 0;
+    zcount = 0;
+    ztail = 0;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : zclose
+// Description  : release the compressed tier
+
+void zclose(void){
+    free(zc.arena);
+    free(zc.keys);
+    free(zc.hash);
+    free(zspans);
+    memset(&zc, 0x0, sizeof(zc));
+    zspans = NULL;
+}
 
 //
 // Functions
@@ -102,27 +755,54 @@ int findcache(LcDeviceId did, uint16_t sec, uint16_t blk){
 
 char * lcloud_getcache( LcDeviceId did, uint16_t sec, uint16_t blk ) {
     int i;
-    for(i=0; i<cachesize; i++){
-        cacheinfo[i].howold += 1; // every caches get old
+    uint64_t tstart = lchist_now();
+
+    if(admission){
+        sketchcount(did, sec, blk);
     }
-    
-    for(i=0; i<cachesize; i++){
-        // if cache exists return block, otherwise get out returning NULL
-        if(cacheinfo[i].did == did && cacheinfo[i].sec == sec && cacheinfo[i].blk == blk){
-            cacheinfo[i].howold = 0; // used, so reset it fresh
-            cdata.hits++; cdata.numaccess++;
-            logMessage(LOG_INFO_LEVEL, "Getting found cache item on index %d, length %d", i, LC_DEVICE_BLOCK_SIZE);
-            logMessage(LOG_INFO_LEVEL, "[INFO] LionCloud Cache ** HIT ** : (%d/%d/%d) index = %d", did, sec, blk, i);
-            logMessage(LOG_INFO_LEVEL, "LC success getting blk [%d/%d/%d] from cache.", did, sec, blk);
-            return cacheinfo[i].cacheblock; // return the found block
-        }
+
+    // if cache exists return block, otherwise get out returning NULL
+    if((i = findcache(did, sec, blk)) != -1){
+        l1.keys[i].lastuse = ++cacheclock; // used, so it is the most recent
+        cdata.hits++; cdata.numaccess++;
+        logMessage(LOG_INFO_LEVEL, "Getting found cache item on index %d, length %d", i, LC_DEVICE_BLOCK_SIZE);
+        logMessage(LOG_INFO_LEVEL, "[INFO] LionCloud Cache ** HIT ** : (%d/%d/%d) index = %d", did, sec, blk, i);
+        logMessage(LOG_INFO_LEVEL, "LC success getting blk [%d/%d/%d] from cache.", did, sec, blk);
+        lchist_record(LC_HIST_GETCACHE, tstart);
+        return &l1.arena[(size_t)i * LC_DEVICE_BLOCK_SIZE]; // return the found block
     }
     
     // fail to find cache
     cdata.misses++; cdata.numaccess++;
+
+    // victim tiers: move the block back up from the compressed tier or L2
+    if(zbytes != 0 || l2file != NULL){
+        char block[LC_DEVICE_BLOCK_SIZE];
+        const char *tier = NULL;
+        if(ztake(did, sec, blk, block) == 0){
+            cdata.zhits++;
+            tier = "COMPRESSED";
+        }
+        else if(l2file != NULL){
+            if(l2take(did, sec, blk, block) == 0){
+                cdata.l2hits++;
+                tier = "L2";
+            }
+            else{
+                cdata.l2misses++;
+            }
+        }
+        if(tier != NULL){
+            i = insertblock(did, sec, blk, block, (cachesize == maxblock) ? findLRU() : -1);
+            logMessage(LOG_INFO_LEVEL, "LionCloud Cache ** %s HIT ** : (%d/%d/%d) index = %d", tier, did, sec, blk, i);
+            lchist_record(LC_HIST_GETCACHE, tstart);
+            return &l1.arena[(size_t)i * LC_DEVICE_BLOCK_SIZE];
+        }
+    }
     logMessage(LOG_INFO_LEVEL, "Getting cache item (not found!)");
     logMessage(LOG_INFO_LEVEL, "LionCloud Cache ** MISS ** : (%d/%d/%d)", did, sec, blk);
     /* Return not found */
+    lchist_record(LC_HIST_GETCACHE, tstart);
     return( NULL );
 }
 
@@ -139,72 +819,48 @@ char * lcloud_getcache( LcDeviceId did, uint16_t sec, uint16_t blk ) {
 int lcloud_putcache( LcDeviceId did, uint16_t sec, uint16_t blk, char *block ) {
     int i;
     int LRU;
-    for(i=0; i<cachesize; i++){
-        cacheinfo[i].howold += 1; // every caches get old
-    }
-
-    for(i=0; i<maxblock; i++){
+    uint64_t tstart = lchist_now();
 
-        /*************** if cache exists, update the cache ***************/
-        if(cacheinfo[i].did == did && cacheinfo[i].sec == sec && cacheinfo[i].blk == blk){
-            cdata.hits++; cdata.numaccess++;
-            cacheinfo[i].cacheline = i;
-            cacheinfo[i].howold = 0; // reset to fresh cache
-            logMessage(LOG_INFO_LEVEL, "Getting found cache item on index %d, length %d", i, LC_DEVICE_BLOCK_SIZE);
-            logMessage(LOG_INFO_LEVEL, "Removing found cache item on index %d, length %d", i, LC_DEVICE_BLOCK_SIZE );
-            memcpy(cacheinfo[i].cacheblock, block, LC_DEVICE_BLOCK_SIZE); // update cache with new writing data
-            return 0;
+    /*************** if cache exists, update the cache ***************/
+    if((i = findcache(did, sec, blk)) != -1){
+        cdata.hits++; cdata.numaccess++;
+        l1.keys[i].lastuse = ++cacheclock; // reset to fresh cache
+        logMessage(LOG_INFO_LEVEL, "Getting found cache item on index %d, length %d", i, LC_DEVICE_BLOCK_SIZE);
+        logMessage(LOG_INFO_LEVEL, "Removing found cache item on index %d, length %d", i, LC_DEVICE_BLOCK_SIZE );
+        if(block != &l1.arena[(size_t)i * LC_DEVICE_BLOCK_SIZE]){
+            memcpy(&l1.arena[(size_t)i * LC_DEVICE_BLOCK_SIZE], block, LC_DEVICE_BLOCK_SIZE); // update cache with new writing data
         }
+        lchist_record(LC_HIST_PUTCACHE, tstart);
+        return 0;
     }
 
 
+    cdata.misses++; cdata.numaccess++;
+    ztake(did, sec, blk, NULL); // any lower tier copy is stale now
+    l2take(did, sec, blk, NULL);
+    logMessage(LOG_INFO_LEVEL, "Getting cache item (not found!)");
+
     /************** check if the cache is full -> LRU replacement **************/
-    if(cachesize == LC_CACHE_MAXBLOCKS){
-        cdata.misses++; cdata.numaccess++;
+    if(cachesize == maxblock){
         LRU = findLRU();
-        cacheinfo[i].cacheline = LRU;
-
-        // set inserting cache info
-        cacheinfo[LRU].did = did;
-        cacheinfo[LRU].sec = sec;
-        cacheinfo[LRU].blk = blk;
-        memcpy(cacheinfo[LRU].cacheblock, block, LC_DEVICE_BLOCK_SIZE); // update LRU cache with new data
-        cacheinfo[LRU].howold = 0; // reset to fresh cache
 
-        logMessage(LOG_INFO_LEVEL, "Getting cache item (not found!)");
-        logMessage(LOG_INFO_LEVEL, "Ejecting cache item index %d, length %d", LRU, LC_DEVICE_BLOCK_SIZE);
-        logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cdata.numitem, LC_DEVICE_BLOCK_SIZE);
-        logMessage(LOG_INFO_LEVEL, "Added cache item index %d, length %d", LRU, LC_DEVICE_BLOCK_SIZE);
-        logMessage(LOG_INFO_LEVEL, "LionCloud Cache success inserting cache item (%d/%d/%d) index= %d", did,sec,blk,LRU);
+        // admission filter: only replace the victim with a block looked up more often
+        if(admission && l1.keys[LRU].valid && sketchestimate(did, sec, blk) <= sketchestimate(l1.keys[LRU].did, l1.keys[LRU].sec, l1.keys[LRU].blk)){
+            cdata.rejected++;
+            logMessage(LOG_INFO_LEVEL, "LionCloud Cache admission rejected (%d/%d/%d)", did, sec, blk);
+            lchist_record(LC_HIST_PUTCACHE, tstart);
+            return 0;
+        }
+        insertblock(did, sec, blk, block, LRU);
     }
 
-
     /************* if cache does not exist, insert cache at the end **************/
     else{
-        
-        cdata.misses++; cdata.numaccess++;
-        cacheinfo[i].cacheline = cachesize;
-        cdata.numitem += 1; // increment the number of cache item
-        
-
-        // set inserting cache info
-        cacheinfo[cachesize].did = did;
-        cacheinfo[cachesize].sec = sec;
-        cacheinfo[cachesize].blk = blk;
-        memcpy(cacheinfo[cachesize].cacheblock, block, LC_DEVICE_BLOCK_SIZE); //put data into the cache
-        cdata.bytesused += sizeof(cacheinfo[cachesize].cacheblock);
-        cacheinfo[cachesize].howold = 0; // fresh cache
-        cachesize += 1; // increment the cache size
-    
-        logMessage(LOG_INFO_LEVEL, "Getting cache item (not found!)");
-        logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cdata.numitem, cdata.bytesused);
-        logMessage(LOG_INFO_LEVEL, "Added cache item index %d, length %d", i, LC_DEVICE_BLOCK_SIZE);
-        logMessage(LOG_INFO_LEVEL, "LionCloud Cache success inserting cache item (%d/%d/%d) index= %d", did,sec,blk,i);
+        insertblock(did, sec, blk, block, -1);
     }
-    
-    
-    
+
     /* Return successfully */
+    lchist_record(LC_HIST_PUTCACHE, tstart);
     return( 0 );
 }
 
@@ -218,26 +874,70 @@ int lcloud_putcache( LcDeviceId did, uint16_t sec, uint16_t blk, char *block ) {
 
 int lcloud_initcache( int maxblocks ) {
 
-    int i=0;
+    uint32_t hashslots;
+    size_t pagesize = sysconf(_SC_PAGESIZE);
 
-    logMessage(LOG_INFO_LEVEL, "init_cmpsc311_cache: initialization complete [%d/%d]", LC_CACHE_MAXBLOCKS, LC_CACHE_MAXBLOCKS*LC_DEVICE_BLOCK_SIZE);
+    logMessage(LOG_INFO_LEVEL, "init_cmpsc311_cache: initialization complete [%d/%d]", maxblocks, maxblocks*LC_DEVICE_BLOCK_SIZE);
     logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cdata.numitem, cdata.bytesused);
-    
-    // cache info initialization
-    cacheinfo = (cachesys *)malloc(sizeof(cachesys) * maxblocks); // 64 cache lines
-    while(i<maxblocks){
-        cacheinfo[i].did = -1;
-        cacheinfo[i].sec = -1;
-        cacheinfo[i].blk = -1;
-        cacheinfo[i].howold = 0;
-        memset(cacheinfo[i].cacheblock, 0, LC_DEVICE_BLOCK_SIZE);
-        i++;
+
+    // key array (64-byte aligned) and its hash index (at most half full)
+    for(hashslots=16; hashslots < 2*(uint32_t)maxblocks; hashslots <<= 1);
+    l1.hashmask = hashslots - 1;
+    if(posix_memalign((void **)&l1.keys, 64, sizeof(cachekey) * maxblocks) != 0 ||
+       (l1.hash = (int32_t *)malloc(sizeof(int32_t) * hashslots)) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate cache metadata for %d blocks", maxblocks);
+        return( -1 );
+    }
+    memset(l1.keys, 0x0, sizeof(cachekey) * maxblocks);
+    memset(l1.hash, 0xff, sizeof(int32_t) * hashslots);
+    cacheclock = 0;
+
+    // payload arena, page aligned; huge pages when asked for (falling back
+    // to transparent huge pages, then normal pages)
+    l1.arenasize = ((size_t)maxblocks * LC_DEVICE_BLOCK_SIZE + pagesize - 1) & ~(pagesize - 1);
+    l1.arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if(hugepages){
+        size_t hugesize = (l1.arenasize + LC_CACHE_HUGEPAGE - 1) & ~((size_t)LC_CACHE_HUGEPAGE - 1);
+        l1.arena = mmap(NULL, hugesize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if(l1.arena != MAP_FAILED){
+            l1.arenasize = hugesize;
+        }
+    }
+#endif
+    if(l1.arena == MAP_FAILED){
+        l1.arena = mmap(NULL, l1.arenasize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if(l1.arena == MAP_FAILED){
+            logMessage(LOG_ERROR_LEVEL, "Failed to map cache payload arena (%lu bytes)", l1.arenasize);
+            return( -1 );
+        }
+#ifdef MADV_HUGEPAGE
+        if(hugepages){
+            madvise(l1.arena, l1.arenasize, MADV_HUGEPAGE);
+        }
+#endif
     }
 
     // cache data initialization
     cdata.hits =0;
     cdata.misses =0;
     cdata.numaccess =0;
+    cdata.evictions =0;
+    cdata.prefetches =0;
+    cdata.inserts =0;
+    cdata.rejected =0;
+    cdata.l2hits =0;
+    cdata.l2misses =0;
+    cdata.l2inserts =0;
+    cdata.l2evictions =0;
+    cdata.l2items =0;
+    cdata.zhits =0;
+    cdata.zinserts =0;
+    cdata.zevictions =0;
+    cdata.zitems =0;
+    cdata.zstored =0;
+    cdata.zcompressns =0;
+    cdata.zdecompressns =0;
     cdata.currentLRU = 0;
     cdata.currentLRUage = 0;
     cdata.bytesused = 0;
@@ -247,6 +947,39 @@ int lcloud_initcache( int maxblocks ) {
     cachesize = 0;
     maxblock = maxblocks;
 
+    // admission filter sketch
+    sketch.counts = NULL;
+    if(admission){
+        for(sketch.width=1; sketch.width < (uint32_t)maxblocks * LC_CACHE_SKETCHWIDTH; sketch.width <<= 1);
+        sketch.samplesize = maxblocks * LC_CACHE_SAMPLESIZE;
+        sketch.additions = 0;
+        if((sketch.counts = (uint8_t *)calloc(LC_CACHE_SKETCHROWS * sketch.width, sizeof(uint8_t))) == NULL){
+            logMessage(LOG_ERROR_LEVEL, "Failed to allocate cache admission sketch, filter disabled");
+            admission = 0;
+        }
+    }
+
+    // compressed tier
+    if(zbytes != 0 && zopen()){
+        zclose();
+        logMessage(LOG_ERROR_LEVEL, "Compressed cache tier disabled");
+        zbytes = 0;
+    }
+
+    // L2 victim cache
+    if(l2file != NULL && l2open()){
+        l2close();
+        logMessage(LOG_ERROR_LEVEL, "L2 cache disabled");
+        l2file = NULL;
+    }
+
+    // warm restart: reload the hot block set saved at the last close
+    snapkeys = NULL;
+    nsnapkeys = 0;
+    if(snapfile != NULL){
+        loadsnapshot();
+    }
+
 
     /* Return successfully */
     return( 0 );
@@ -261,27 +994,248 @@ int lcloud_initcache( int maxblocks ) {
 // Outputs      : 0 if successful, -1 if failure
 
 int lcloud_closecache( void ) {
-    int i=0;
-    logMessage(LOG_INFO_LEVEL, "Closed cmpsc311 cache, deleting %d items", LC_CACHE_MAXBLOCKS);
+    logMessage(LOG_INFO_LEVEL, "Closed cmpsc311 cache, deleting %d items", cdata.numitem);
     logMessage(LOG_INFO_LEVEL, "Cache hits       [%d]", cdata.hits);
     logMessage(LOG_INFO_LEVEL, "Cache misses     [%d]", cdata.misses);
-    logMessage(LOG_INFO_LEVEL, "Cache efficiency [%0.2f%%]", (float)cdata.hits/(float)cdata.numaccess);
+    logMessage(LOG_INFO_LEVEL, "Cache evictions  [%d]", cdata.evictions);
+    logMessage(LOG_INFO_LEVEL, "Cache rejected   [%d]", cdata.rejected);
+    logMessage(LOG_INFO_LEVEL, "Cache zip hits   [%d]", cdata.zhits);
+    logMessage(LOG_INFO_LEVEL, "Cache L2 hits    [%d]", cdata.l2hits);
+    logMessage(LOG_INFO_LEVEL, "Cache efficiency [%0.2f%%]", (cdata.numaccess == 0) ? 0.0 : 100.0*(float)cdata.hits/(float)cdata.numaccess);
 
-    // clean up
-    while(i<maxblock){
-        cacheinfo[i].did = -1;
-        cacheinfo[i].sec = -1;
-        cacheinfo[i].blk = -1;
-        cacheinfo[i].howold = 0;
-        memset(cacheinfo[i].cacheblock, 0, LC_DEVICE_BLOCK_SIZE);
-        i++;
+    // save the hot block set for the next init
+    if(snapfile != NULL){
+        savesnapshot();
     }
 
     //free
-    free(cacheinfo);
+    free(snapkeys);
+    snapkeys = NULL;
+    nsnapkeys = 0;
+    zclose();
+    l2close();
+    free(l1.keys);
+    free(l1.hash);
+    munmap(l1.arena, l1.arenasize);
+    l1.keys = NULL;
+    l1.hash = NULL;
+    l1.arena = NULL;
+    free(sketch.counts);
+    sketch.counts = NULL;
 
 
 
     /* Return successfully */
     return( 0 );
-}
\ No newline at end of file
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_cachestats
+// Description  : Get the cache performance counters
+//
+// Inputs       : stats - structure to fill with the counters
+// Outputs      : 0 if successful, -1 if failure
+
+int lcloud_cachestats( LcCacheStats *stats ) {
+
+    if(stats == NULL){
+        return( -1 );
+    }
+
+    stats->hits = cdata.hits;
+    stats->misses = cdata.misses;
+    stats->evictions = cdata.evictions;
+    stats->prefetches = cdata.prefetches;
+    stats->inserts = cdata.inserts;
+    stats->rejected = cdata.rejected;
+    stats->items = cdata.numitem;
+    stats->maxitems = maxblock;
+    stats->l2hits = cdata.l2hits;
+    stats->l2misses = cdata.l2misses;
+    stats->l2inserts = cdata.l2inserts;
+    stats->l2evictions = cdata.l2evictions;
+    stats->l2items = cdata.l2items;
+    stats->l2maxitems = (l2file != NULL) ? l2blocks : 0;
+    stats->zhits = cdata.zhits;
+    stats->zinserts = cdata.zinserts;
+    stats->zevictions = cdata.zevictions;
+    stats->zitems = cdata.zitems;
+    stats->zstored = cdata.zstored;
+    stats->zcapacity = zbytes;
+    stats->zcompressns = cdata.zcompressns;
+    stats->zdecompressns = cdata.zdecompressns;
+
+    /* Return successfully */
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_cacheadmission
+// Description  : Enable/disable the TinyLFU admission filter (takes effect
+//                at the next lcloud_initcache)
+//
+// Inputs       : enable - non-zero to enable the filter
+// Outputs      : 0 if successful, -1 if failure
+
+int lcloud_cacheadmission( int enable ) {
+    admission = (enable != 0);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_cachehugepages
+// Description  : Back the cache payload arena with huge pages (takes effect
+//                at the next lcloud_initcache)
+//
+// Inputs       : enable - non-zero to use huge pages
+// Outputs      : 0 if successful, -1 if failure
+
+int lcloud_cachehugepages( int enable ) {
+    hugepages = (enable != 0);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_cachesnapshot
+// Description  : Set the warm restart snapshot file: the cached key set is
+//                saved there at lcloud_closecache and reloaded at the next
+//                lcloud_initcache, then its blocks are re-read from the
+//                devices by lcloud_cacheprefetch.
+//
+// Inputs       : path - snapshot file (kept, not copied), NULL to disable
+// Outputs      : 0 if successful, -1 if failure
+
+int lcloud_cachesnapshot( const char *path ) {
+    snapfile = path;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_cacheprefetch
+// Description  : Prefetch the snapshot keys loaded at init, in batches of
+//                LC_CACHE_PREFETCHBATCH blocks: fetch is called for each block
+//                (it is expected to put it in the cache), then sync, after
+//                which the batch is re-stamped in its saved recency order.
+//                Prefetches are not counted as misses.
+//
+// Inputs       : fetch - queue the read of a block, -1 if it cannot be read
+//                sync - complete the queued reads (called with 1)
+// Outputs      : number of blocks prefetched, -1 if failure
+
+int lcloud_cacheprefetch( LcCacheFetch fetch, int (*sync)(int) ) {
+    int i, j, n, fetched = 0;
+    int misses, numaccess;
+
+    if(fetch == NULL || sync == NULL){
+        return( -1 );
+    }
+    for(i=0; i<nsnapkeys; i+=n){
+        misses = cdata.misses;
+        numaccess = cdata.numaccess;
+        n = (nsnapkeys - i < LC_CACHE_PREFETCHBATCH) ? nsnapkeys - i : LC_CACHE_PREFETCHBATCH;
+        for(j=i; j<i+n; j++){
+            if(findcache(snapkeys[j].did, snapkeys[j].sec, snapkeys[j].blk) == -1){
+                fetch(snapkeys[j].did, snapkeys[j].sec, snapkeys[j].blk);
+            }
+        }
+        if(sync(1)){
+            logMessage(LOG_ERROR_LEVEL, "Failure prefetching cache snapshot blocks");
+            break;
+        }
+        cdata.misses = misses;
+        cdata.numaccess = numaccess;
+
+        // the batch may have been read in any order, restore its recency
+        for(j=i; j<i+n; j++){
+            int line = findcache(snapkeys[j].did, snapkeys[j].sec, snapkeys[j].blk);
+            if(line != -1){
+                l1.keys[line].lastuse = ++cacheclock;
+                fetched++;
+            }
+        }
+    }
+    cdata.prefetches += fetched;
+    logMessage(LOG_INFO_LEVEL, "Prefetched %d of %d cache snapshot blocks", fetched, nsnapkeys);
+
+    free(snapkeys);
+    snapkeys = NULL;
+    nsnapkeys = 0;
+    return( fetched );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_cachel2
+// Description  : Set up an L2 victim cache in a memory mapped host file:
+//                blocks evicted from the cache move there and cache misses
+//                check it before going to the devices (takes effect at the
+//                next lcloud_initcache)
+//
+// Inputs       : path - host file (kept, not copied), NULL to disable
+//                maxblocks - L2 capacity in blocks
+// Outputs      : 0 if successful, -1 if failure
+
+int lcloud_cachel2( const char *path, int maxblocks ) {
+    if(path != NULL && maxblocks <= 0){
+        return( -1 );
+    }
+    l2file = path;
+    l2blocks = maxblocks;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_cachecompress
+// Description  : Set up a compressed tier of the given size in bytes: blocks
+//                evicted from the cache are kept LZ compressed there (before
+//                moving on to L2) and decompressed on a hit (takes effect at
+//                the next lcloud_initcache)
+//
+// Inputs       : bytes - compressed tier size, 0 to disable
+// Outputs      : 0 if successful, -1 if failure
+
+int lcloud_cachecompress( int bytes ) {
+    if(bytes != 0 && bytes < LC_DEVICE_BLOCK_SIZE){
+        return( -1 );
+    }
+    zbytes = bytes;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_cacheinvalidate
+// Description  : Drop blocks from every cache tier (their device blocks were
+//                freed).  Invalidated lines are the first reused.
+//
+// Inputs       : addrs - the blocks
+//                n - number of blocks
+// Outputs      : number of blocks dropped from the cache, -1 if failure
+
+int lcloud_cacheinvalidate( const LcCacheAddr *addrs, int n ) {
+    int i, line, dropped = 0;
+
+    if(addrs == NULL && n > 0){
+        return( -1 );
+    }
+    for(i=0; i<n; i++){
+        ztake(addrs[i].did, addrs[i].sec, addrs[i].blk, NULL);
+        l2take(addrs[i].did, addrs[i].sec, addrs[i].blk, NULL);
+        if((line = findcache(addrs[i].did, addrs[i].sec, addrs[i].blk)) == -1){
+            continue;
+        }
+        hashremove(&l1, line);
+        l1.keys[line].valid = 0;
+        l1.keys[line].lastuse = 0; // oldest, so it is replaced first
+        cdata.numitem -= 1;
+        dropped++;
+    }
+    logMessage(LOG_INFO_LEVEL, "Invalidated %d of %d blocks in cache", dropped, n);
+    return( dropped );
+}
@@ -14,13 +14,32 @@
 // Includes 
 #include <stdint.h>
 #include <lcloud_controller.h>
+#include <lcloud_filesys.h>
 
 // Defines 
 #define LC_CACHE_MAXBLOCKS 64
+#define LC_CACHE_SKETCHROWS 4      // TinyLFU count-min sketch rows (hash functions)
+#define LC_CACHE_SKETCHWIDTH 8     // sketch counters per row, per cache line (rounded up to a power of 2)
+#define LC_CACHE_SAMPLESIZE 10     // accesses per cache line between sketch agings (counters halved)
+#define LC_CACHE_HUGEPAGE (2*1024*1024) // huge page size for the payload arena
+#define LC_CACHE_L2BLOCKS 4096     // default L2 victim cache size (blocks)
+#define LC_CACHE_ZMINSIZE 16       // smallest compressed block expected (sizes the compressed tier's index)
+#define LC_CACHE_PREFETCHBATCH 16  // snapshot blocks read back per batch at a warm restart
+
+// A cached block's address
+typedef struct {
+    LcDeviceId did;
+    uint16_t   sec;
+    uint16_t   blk;
+} LcCacheAddr;
+
+// Snapshot prefetch read: queue the read of a block into the cache
+typedef int (*LcCacheFetch)( LcDeviceId did, uint16_t sec, uint16_t blk );
 
 //
 // Functional Prototypes
 int findcache(LcDeviceId did, uint16_t sec, uint16_t blk);
+    // Index of the cache line holding a block, -1 if not cached
 
 char * lcloud_getcache( LcDeviceId did, uint16_t sec, uint16_t blk );
     // Search the cache for a block 
@@ -34,4 +53,28 @@ int lcloud_initcache( int maxblocks );
 int lcloud_closecache( void );
     // Clean up the cache when program is closing.
 
+int lcloud_cachestats( LcCacheStats *stats );
+    // Get the cache performance counters
+
+int lcloud_cacheadmission( int enable );
+    // Enable/disable the TinyLFU admission filter (takes effect at the next init)
+
+int lcloud_cachehugepages( int enable );
+    // Back the payload arena with huge pages (takes effect at the next init)
+
+int lcloud_cachesnapshot( const char *path );
+    // Save the hot block set (keys only) to path at close and reload it at init
+
+int lcloud_cacheprefetch( LcCacheFetch fetch, int (*sync)(int) );
+    // Read back the blocks of the snapshot loaded at init
+
+int lcloud_cachel2( const char *path, int maxblocks );
+    // Add an L2 victim cache in a memory mapped host file (takes effect at the next init)
+
+int lcloud_cachecompress( int bytes );
+    // Add a compressed tier of bytes bytes below the cache (takes effect at the next init)
+
+int lcloud_cacheinvalidate( const LcCacheAddr *addrs, int n );
+    // Drop blocks from every cache tier (their device blocks were freed)
+
 #endif
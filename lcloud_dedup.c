@@ -0,0 +1,390 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_dedup.c
+//  Description    : This is the block deduplication index for the LionCloud
+//                   filesystem.  Each indexed device block has an entry with
+//                   a fast 64-bit hash of its contents, its crypto hash and
+//                   a reference count; entries are chained in two hash
+//                   tables, by fast hash (to find duplicates) and by device
+//                   address (to drop references on overwrite).  The entries
+//                   and tables are allocated at the first insert and grow
+//                   with the number of blocks indexed.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+#include <lcloud_controller.h>
+#include <lcloud_dedup.h>
+
+// an indexed device block
+typedef struct {
+    uint64_t fast;                        // fast hash of the contents
+    uint8_t  digest[LC_DEDUP_MAXDIGEST];  // crypto hash of the contents
+    int32_t  dev;                         // storage index/sector/block
+    int32_t  sec;
+    int32_t  blk;
+    uint32_t refs;                        // file blocks using it
+    int32_t  fpnext;                      // next entry in the fast hash chain (or free list)
+    int32_t  addrnext;                    // next entry in the address chain
+}dedupentry;
+
+static int dedupenabled = 0;
+static dedupentry *entries = NULL;     // capentries entries
+static int32_t *fpheads = NULL;        // fast hash chains (-1 terminated)
+static int32_t *addrheads = NULL;      // address chains
+static uint32_t bucketmask;            // buckets - 1 (both tables)
+static int32_t freeentry = -1;         // free list of released entries
+static int32_t nextentry;              // entries below this have been used
+static int32_t capentries;             // entries allocated
+static int32_t maxentries;             // most entries the index may grow to
+static int digestlen;                  // crypto hash length
+static LcDedupStats dedupstats;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dedup_fast
+// Description  : fast (non-crypto) hash of a block, FNV-1a over 64-bit words
+//
+// Inputs       : data - the block
+// Outputs      : hash
+
+static uint64_t dedup_fast(const char *data){
+    uint64_t h = 0xcbf29ce484222325ULL, w;
+    int i;
+
+    for(i=0; i<LC_DEVICE_BLOCK_SIZE; i+=sizeof(w)){
+        memcpy(&w, &data[i], sizeof(w));
+        h = (h ^ w) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dedup_addr
+// Description  : address chain of a device block
+
+static uint32_t dedup_addr(int dev, int sec, int blk){
+    return (((uint32_t)dev * 0x9e3779b1) ^ ((uint32_t)sec << 12) ^ (uint32_t)blk) & bucketmask;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dedup_entry
+// Description  : the index entry of a device block, -1 if it is not indexed
+
+static int32_t dedup_entry(int dev, int sec, int blk){
+    int32_t e;
+
+    for(e=addrheads[dedup_addr(dev, sec, blk)]; e != -1; e=entries[e].addrnext){
+        if(entries[e].dev == dev && entries[e].sec == sec && entries[e].blk == blk){
+            break;
+        }
+    }
+    return( e );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dedup_unlink
+// Description  : remove an entry from a chain
+//
+// Inputs       : head - the chain head
+//                e - the entry
+//                addr - non-zero for an address chain, zero for a fast hash chain
+
+static void dedup_unlink(int32_t *head, int32_t e, int addr){
+    int32_t *link;
+
+    for(link=head; *link != e; link = addr ? &entries[*link].addrnext : &entries[*link].fpnext);
+    *link = addr ? entries[e].addrnext : entries[e].fpnext;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dedup_grow
+// Description  : double the entries (LC_DEDUP_MINENTRIES the first time, at
+//                most maxentries) and rebuild both chains over tables sized
+//                to match
+//
+// Outputs      : 0 if successful, -1 if failure (or the index is full)
+
+static int dedup_grow(void){
+    dedupentry *grown;
+    int32_t *fp = NULL, *addr = NULL, e, n;
+    uint32_t buckets;
+
+    if(capentries == maxentries){
+        return( -1 );
+    }
+    n = (capentries == 0) ? LC_DEDUP_MINENTRIES : capentries * 2;
+    if(n > maxentries){
+        n = maxentries;
+    }
+    for(buckets=16; buckets < (uint32_t)n; buckets <<= 1);
+    if((grown = (dedupentry *)realloc(entries, sizeof(dedupentry) * n)) == NULL ||
+       (fp = (int32_t *)malloc(sizeof(int32_t) * buckets)) == NULL ||
+       (addr = (int32_t *)malloc(sizeof(int32_t) * buckets)) == NULL){
+        if(grown != NULL){
+            entries = grown;
+        }
+        free(fp);
+        logMessage(LOG_ERROR_LEVEL, "Failed to grow deduplication index to %d blocks", n);
+        return( -1 );
+    }
+    entries = grown;
+    capentries = n;
+    free(fpheads);
+    free(addrheads);
+    fpheads = fp;
+    addrheads = addr;
+    bucketmask = buckets - 1;
+    memset(fpheads, 0xff, sizeof(int32_t) * buckets);
+    memset(addrheads, 0xff, sizeof(int32_t) * buckets);
+
+    // (released entries have no references and stay on the free list)
+    for(e=0; e<nextentry; e++){
+        if(entries[e].refs > 0){
+            entries[e].fpnext = fpheads[entries[e].fast & bucketmask];
+            fpheads[entries[e].fast & bucketmask] = e;
+            entries[e].addrnext = addrheads[dedup_addr(entries[e].dev, entries[e].sec, entries[e].blk)];
+            addrheads[dedup_addr(entries[e].dev, entries[e].sec, entries[e].blk)] = e;
+        }
+    }
+    logMessage(LcDriverLLevel, "Deduplication index grown to %d blocks", n);
+    return( 0 );
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdedup_enable
+// Description  : Enable/disable deduplication (takes effect at the next
+//                lcdedup_init, i.e. power on)
+//
+// Inputs       : enable - non-zero to deduplicate
+// Outputs      : 0 if successful, -1 if failure
+
+int lcdedup_enable( int enable ) {
+    dedupenabled = (enable != 0);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdedup_init
+// Description  : Set up an empty index (nothing is allocated until the
+//                first block is indexed)
+//
+// Inputs       : maxblocks - device blocks that can be indexed
+// Outputs      : 0 if successful, -1 if failure
+
+int lcdedup_init( int maxblocks ) {
+    lcdedup_close();
+    memset(&dedupstats, 0x0, sizeof(dedupstats));
+    if(!dedupenabled || maxblocks <= 0){
+        return( 0 );
+    }
+
+    if(!gcry_control(GCRYCTL_INITIALIZATION_FINISHED_P)){
+        gcry_check_version(NULL);
+        gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+    }
+    if((digestlen = CMPSC311_HASH_LENGTH) > LC_DEDUP_MAXDIGEST){
+        digestlen = LC_DEDUP_MAXDIGEST;
+    }
+
+    maxentries = maxblocks;
+    dedupstats.enabled = 1;
+
+    logMessage(LcDriverLLevel, "Deduplication index initialized (up to %d blocks)", maxblocks);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdedup_close
+// Description  : Release the index
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int lcdedup_close( void ) {
+    free(entries);
+    free(fpheads);
+    free(addrheads);
+    entries = NULL;
+    fpheads = NULL;
+    addrheads = NULL;
+    freeentry = -1;
+    nextentry = 0;
+    capentries = 0;
+    maxentries = 0;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdedup_find
+// Description  : Find a placed block with the same contents (candidates by
+//                fast hash, confirmed by crypto hash) and take a reference
+//
+// Inputs       : data - the block contents
+//                dev, sec, blk - filled with the block found
+// Outputs      : 1 if found, 0 if not, -1 if failure
+
+int lcdedup_find( const char *data, int *dev, int *sec, int *blk ) {
+    uint8_t digest[LC_DEDUP_MAXDIGEST];
+    uint64_t fast;
+    int32_t e;
+    int hashed = 0;
+
+    if(!dedupstats.enabled){
+        return( 0 );
+    }
+    dedupstats.lookups++;
+    if(entries == NULL){
+        return( 0 );
+    }
+    fast = dedup_fast(data);
+    for(e=fpheads[fast & bucketmask]; e != -1; e=entries[e].fpnext){
+        if(entries[e].fast != fast){
+            continue;
+        }
+        if(!hashed){
+            gcry_md_hash_buffer(CMPSC311_HASH_TYPE, digest, data, LC_DEVICE_BLOCK_SIZE);
+            hashed = 1;
+        }
+        if(memcmp(entries[e].digest, digest, digestlen) != 0){
+            dedupstats.collisions++;
+            continue;
+        }
+        if(++entries[e].refs == 2){
+            dedupstats.shared++;
+        }
+        dedupstats.hits++;
+        *dev = entries[e].dev;
+        *sec = entries[e].sec;
+        *blk = entries[e].blk;
+        logMessage(LcDriverLLevel, "Deduplicated block at [%d/%d/%d] (%u references)", *dev, *sec, *blk, entries[e].refs);
+        return( 1 );
+    }
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdedup_insert
+// Description  : Index a newly placed block with one reference
+//
+// Inputs       : data - the block contents
+//                dev, sec, blk - where it was placed
+// Outputs      : 0 if successful, -1 if failure
+
+int lcdedup_insert( const char *data, int dev, int sec, int blk ) {
+    dedupentry *ent;
+    int32_t e;
+
+    if(maxentries == 0){
+        return( 0 );
+    }
+    if(freeentry == -1 && nextentry == capentries && dedup_grow()){
+        logMessage(LOG_ERROR_LEVEL, "Deduplication index full, block [%d/%d/%d] not indexed", dev, sec, blk);
+        return( -1 );
+    }
+    if((e = freeentry) != -1){
+        freeentry = entries[e].fpnext;
+    }
+    else{
+        e = nextentry++;
+    }
+    ent = &entries[e];
+    ent->fast = dedup_fast(data);
+    gcry_md_hash_buffer(CMPSC311_HASH_TYPE, ent->digest, data, LC_DEVICE_BLOCK_SIZE);
+    ent->dev = dev;
+    ent->sec = sec;
+    ent->blk = blk;
+    ent->refs = 1;
+    ent->fpnext = fpheads[ent->fast & bucketmask];
+    fpheads[ent->fast & bucketmask] = e;
+    ent->addrnext = addrheads[dedup_addr(dev, sec, blk)];
+    addrheads[dedup_addr(dev, sec, blk)] = e;
+    dedupstats.entries++;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdedup_release
+// Description  : Drop a reference to a block being overwritten or freed; the
+//                last user's block leaves the index (its contents change)
+//
+// Inputs       : dev, sec, blk - the block
+// Outputs      : references left (0 if the block is the caller's alone)
+
+int lcdedup_release( int dev, int sec, int blk ) {
+    int32_t e;
+
+    if(entries == NULL || (e = dedup_entry(dev, sec, blk)) == -1){
+        return( 0 );
+    }
+
+    dedupstats.releases++;
+    if(--entries[e].refs > 0){
+        if(entries[e].refs == 1){
+            dedupstats.shared--;
+        }
+        dedupstats.unshares++;
+        return( entries[e].refs );
+    }
+    dedup_unlink(&fpheads[entries[e].fast & bucketmask], e, 0);
+    dedup_unlink(&addrheads[dedup_addr(dev, sec, blk)], e, 1);
+    entries[e].fpnext = freeentry;
+    freeentry = e;
+    dedupstats.entries--;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdedup_refs
+// Description  : Count the references to a block (without taking one)
+//
+// Inputs       : dev, sec, blk - the block
+// Outputs      : references to it (0 if it is not indexed)
+
+int lcdedup_refs( int dev, int sec, int blk ) {
+    int32_t e;
+
+    if(entries == NULL || (e = dedup_entry(dev, sec, blk)) == -1){
+        return( 0 );
+    }
+    return( entries[e].refs );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdedup_stats
+// Description  : Get the deduplication counters
+//
+// Inputs       : stats - structure to fill with the counters
+// Outputs      : 0 if successful, -1 if failure
+
+int lcdedup_stats( LcDedupStats *stats ) {
+    if(stats == NULL){
+        return( -1 );
+    }
+    *stats = dedupstats;
+    return( 0 );
+}
@@ -0,0 +1,56 @@
+#ifndef LCLOUD_DEDUP_INCLUDED
+#define LCLOUD_DEDUP_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_dedup.h
+//  Description    : This is the block deduplication API for the LionCloud
+//                   filesystem.  Placed blocks are indexed by content (a fast
+//                   hash to find candidates, the CMPSC311 crypto hash to
+//                   confirm them) with reference counts, so a new block with
+//                   the same contents can share the existing device block.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdint.h>
+#include <lcloud_filesys.h>
+
+// Defines
+#define LC_DEDUP_MAXDIGEST 32          // largest crypto hash kept per block
+#define LC_DEDUP_MINENTRIES 1024       // index entries allocated at the first insert (doubled as needed)
+
+//
+// Functional Prototypes
+
+int lcdedup_enable( int enable );
+    // Enable/disable deduplication (takes effect at the next init)
+
+int lcdedup_init( int maxblocks );
+    // Set up an empty index for up to maxblocks device blocks (0 if disabled);
+    // its memory is only allocated as blocks are indexed
+
+int lcdedup_close( void );
+    // Release the index
+
+int lcdedup_find( const char *data, int *dev, int *sec, int *blk );
+    // Find a placed block with these contents and take a reference to it
+    // (1 if found, 0 if not or deduplication is disabled)
+
+int lcdedup_insert( const char *data, int dev, int sec, int blk );
+    // Index a newly placed block with one reference
+
+int lcdedup_release( int dev, int sec, int blk );
+    // Drop a reference to a block whose contents are being overwritten or
+    // freed (references left to it; 0 if the caller was its only user and
+    // it is no longer indexed)
+
+int lcdedup_refs( int dev, int sec, int blk );
+    // References to a block (0 if it is not indexed)
+
+int lcdedup_stats( LcDedupStats *stats );
+    // Get the deduplication counters
+
+#endif
@@ -17,6 +17,10 @@
 #include <lcloud_filesys.h>
 #include <lcloud_controller.h>
 #include <lcloud_cache.h>
+#include <lcloud_histo.h>
+#include <lcloud_sched.h>
+#include <lcloud_dedup.h>
+#include <lcloud_parity.h>
 
 //bool typedef
 typedef int bool;
@@ -28,11 +32,28 @@ static LCloudRegisterFrame frm, rfrm, b0, b1, c0, c1, c2, d0, d1;
 int numdevice; //number of devices // there are 5 devices in assign3
 #define filenum 33
 #define devicenum 5
+#define delaymax 32         // dirty blocks a file holds before allocating them
+#define BLK_UNALLOCATED -1  // blkaddr.dev: never written
+#define BLK_DELAYED -2      // blkaddr.dev: written, waiting for allocation (sec = delayed slot)
+#define BLK_RESERVED 2      // device storage: slot of a file's cluster, not yet written
 
 
 //LcDeviceId did;
 bool isDeviceOn;
 
+// location of a file block on the devices
+typedef struct{
+    int dev;            // storage index of the device (or BLK_UNALLOCATED/BLK_DELAYED)
+    int sec;
+    int blk;
+}blkaddr;
+
+// a written block waiting for its device block
+typedef struct{
+    uint32_t fblk;
+    char data[LC_DEVICE_BLOCK_SIZE];
+}delayblk;
+
 typedef struct{
     char *fname;
     LcFHandle fhandle;
@@ -40,126 +61,643 @@ typedef struct{
     uint32_t pos;
     int flength;
     //device info <-> file 
-    int wfnow;           // file's most recently wrote device number (storage index)
-    int rfnow;
-    LcDeviceId fdid;    // file's most recently wrote did
-    int fsec;           // file's most recently wrote sector
-    int fblk;           // file's most recently wrote block
+    blkaddr *blkmap;    // file block number (pos/256) -> device block
+    int mapsize;        // number of entries in blkmap
+    //tail buffer: small appends collect here until the block fills
+    char tail[LC_DEVICE_BLOCK_SIZE];
+    int tailblk;        // file block held in tail, -1 if none
+    bool tailheld;      // the tail block is new and holds a free block (delayreserve)
+    //delayed allocation: written blocks are placed on the devices as runs at flush
+    delayblk *delayed;  // delaymax slots (allocated on first use)
+    int ndelayed;
+    //replication: copies-1 more maps, the replicas of each placed block
+    int copies;
+    blkaddr *mirror[LC_MAX_COPIES-1];
+    //parity striping: stripes of width data units of unit blocks, parity
+    //block of each row (stripe * unit + block in unit)
+    int width;
+    int unit;
+    blkaddr *parity;
+    //clusters (lccluster): the device run reserved for each cluster of the file
+    blkaddr *clmap;     // first device block of each cluster (fblk / clusterblks)
+    int clmapsize;
+    uint32_t nextread;  // file block after the last read (sequential reads read in clusters)
+    //inline file (lcinline): the contents live here, no blocks, until it grows past the threshold
+    char *inldata;      // LC_INLINE_MAXBYTES bytes, NULL if the file is in blocks
+    //tail packing (lctailpack): the partial last block (flength % 256 bytes) of a
+    //closed file kept in a shared pack block, its map entry is a hole
+    int packslot;       // pack block (index into packs), -1 if not packed
+    int packoff;        // first byte of the tail in the pack block
 
 
 }filesys;
 filesys finfo[filenum]; //file structure
 
+// a block shared by the packed tails of several files
+typedef struct{
+    blkaddr addr;       // device block (dev BLK_UNALLOCATED if the slot is unused)
+    uint16_t used;      // granules in use (bit g - bytes from g * LC_PACK_GRANULE)
+}packblk;
+
 typedef struct{
     LcDeviceId did;
-    int sec;
-    int blk;
-    int rsec;
-    int rblk;
-    char **storage;        // 0 - empty   1- allocated  2- full
+    char **storage;        // 0 - empty   1- allocated   2- reserved (BLK_RESERVED)
     char **fileblktracker; // each block contains file handle
-    uint16_t **filepostracker;  // each block contains filepos (beginning of the blk)
+    uint32_t **filepostracker;  // each block contains file block number (filepos/256)
     int maxsec; 
     int maxblk;
-    int devwritten;        // total bytes written in a device
-    int devread;
-    int numwritten;
-    
+    int nfree;             // blocks not allocated
+    int64_t credit;        // weighted placement: allocations owed to the device
+    int errors;            // failed transfers not yet worked off, the device's replicas are read last
+    int goodxfers;         // successful transfers towards working off the next one (devrecover)
 }device;
 device *devinfo;
 
 /*********global variables**********/
 int allocatedblock = 0; // number of blocks allocated
 int totalblock = 0;     // total number of blocks calculated during allocation
+int delayedblocks = 0;  // delayed blocks of all files, each holding a free block (delayreserve)
 int now = 0;            // current writing device id
-int readnow = 0;         // current reading device id
-int prevfilesnow = 0;   //previous file's device id
-bool findnextfreedev;   // if file went back to block to fill the block, find next free device or not
+LcStats fsstats;        // performance counters (reset at power on)
+bool zeroholes = false; // all-zero blocks are stored as holes
+LcPlacePolicy placement = LC_PLACE_FILL; // device placement policy
+int clusterblks = 1;    // device blocks per allocation cluster (lccluster)
+int inlinemax = 0;      // new files up to this many bytes are kept inline (lcinline)
+bool tailpack = false;  // partial last blocks are packed at close (lctailpack)
+packblk *packs = NULL;  // pack blocks
+int npacks = 0;         // slots in packs
+int lastpack = -1;      // pack block written last
+bool deferreads = false; // lcsubmit: reads leave their queued device reads to the batch
+int deferred = 0;        // device reads left queued by the read being run
+int deferfailed = 0;     // set to -1 when a device read of the batch fails
+LcCompletion cring[LC_RING_ENTRIES]; // completions not reaped yet (lcpoll)
+uint32_t chead = 0;     // next completion reaped
+uint32_t ctail = 0;     // next completion slot filled
+const char *LC_PLACE_POLICY_LABELS[LC_PLACE_MAXPOLICY] = { "fill", "weighted" };
 
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : getfreeblk
-// Description  : iterate the storage(2d array) and find the free sector(i)&block(j) to read/write
+// Function     : devindex
+// Description  : find the storage index of a device id, -1 if unknown
 
-void getfreeblk(int n, LcFHandle fh){ //argument = now 
-    int i,j;
+int devindex(LcDeviceId did){
+    int n;
 
-    for(i=0; i<devinfo[n].maxsec; i++){
-        for(j=0; j<devinfo[n].maxblk; j++){
-            if(devinfo[n].storage[i][j] == 0){
-                devinfo[n].sec = i;
-                devinfo[n].blk = j;
-                now = n;
-                return ;
-            }
+    for(n=0; n<devicenum; n++){
+        if(devinfo[n].did == did){
+            return n;
+        }
+    }
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : nextdevice
+// Description  : move onto next device
+
+void nextdevice(int *n){
+    if(*n>=devicenum-1){
+        *n=0;
+    }
+    else{
+        (*n)++;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : placeweight
+// Description  : weighted placement share of a device: its free blocks,
+//                scaled down by its queue: LC_PLACE_QUEUESCALE queued requests halve it
+
+int64_t placeweight(int n){
+    return (int64_t)devinfo[n].nfree * LC_PLACE_QUEUESCALE / (LC_PLACE_QUEUESCALE + lcsched_depth(devinfo[n].did));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : placedevice
+// Description  : pick the device to look at first for a new allocation.
+//                Under LC_PLACE_WEIGHTED this is the device with the most
+//                credit (see placecharge), so large idle devices take
+//                proportionally more blocks than small or busy ones.
+
+int placedevice(void){
+    int n, best = -1;
+
+    if(placement == LC_PLACE_FILL){
+        return now;
+    }
+    for(n=0; n<devicenum; n++){
+        if(devinfo[n].nfree > 0 && (best == -1 || devinfo[n].credit > devinfo[best].credit)){
+            best = n;
         }
     }
+    return (best == -1) ? now : best;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : placecharge
+// Description  : smooth weighted round robin accounting for blocks placed on
+//                a device: every device earns its weight per block, the
+//                device that took them pays the total weight per block
+
+void placecharge(int dev, int blocks){
+    int64_t weight, total = 0;
+    int n;
+
+    if(placement == LC_PLACE_FILL){
+        return;
+    }
+    for(n=0; n<devicenum; n++){
+        weight = placeweight(n);
+        devinfo[n].credit += weight * blocks;
+        total += weight;
+    }
+    devinfo[dev].credit -= total * blocks;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : findsamefileblock
-// Description  : iterate the storage(2d array) and find the blocks that has same fh
+// Function     : devmetafree
+// Description  : free a device's block metadata (if it was ever set up)
+
+void devmetafree(int d){
+    if(devinfo[d].storage != NULL){
+        free(devinfo[d].storage[0]);
+    }
+    if(devinfo[d].fileblktracker != NULL){
+        free(devinfo[d].fileblktracker[0]);
+    }
+    if(devinfo[d].filepostracker != NULL){
+        free(devinfo[d].filepostracker[0]);
+    }
+    free(devinfo[d].storage);
+    free(devinfo[d].fileblktracker);
+    free(devinfo[d].filepostracker);
+    devinfo[d].storage = NULL;
+    devinfo[d].fileblktracker = NULL;
+    devinfo[d].filepostracker = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : devmeta
+// Description  : set up a device's block metadata (state, owning file and
+//                file block of each block) the first time the allocator
+//                looks at the device: one zeroed (calloc) array each, whose
+//                pages only get backed as they are used
+
+int devmeta(int d){
+    size_t nblk = (size_t)devinfo[d].maxsec * devinfo[d].maxblk;
+    int i;
+
+    if(devinfo[d].storage != NULL){
+        return 0;
+    }
+    //(a device reporting no blocks has nothing to allocate)
+    if(nblk == 0){
+        return -1;
+    }
+    if((devinfo[d].storage = (char **)calloc(devinfo[d].maxsec, sizeof(char *))) == NULL ||
+       (devinfo[d].fileblktracker = (char **)calloc(devinfo[d].maxsec, sizeof(char *))) == NULL ||
+       (devinfo[d].filepostracker = (uint32_t **)calloc(devinfo[d].maxsec, sizeof(uint32_t *))) == NULL ||
+       (devinfo[d].storage[0] = (char *)calloc(nblk, sizeof(char))) == NULL ||
+       (devinfo[d].fileblktracker[0] = (char *)calloc(nblk, sizeof(char))) == NULL ||
+       (devinfo[d].filepostracker[0] = (uint32_t *)calloc(nblk, sizeof(uint32_t))) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate block metadata of device %d", devinfo[d].did);
+        devmetafree(d);
+        return -1;
+    }
+    for(i=1; i<devinfo[d].maxsec; i++){
+        devinfo[d].storage[i] = devinfo[d].storage[0] + (size_t)i * devinfo[d].maxblk;
+        devinfo[d].fileblktracker[i] = devinfo[d].fileblktracker[0] + (size_t)i * devinfo[d].maxblk;
+        devinfo[d].filepostracker[i] = devinfo[d].filepostracker[0] + (size_t)i * devinfo[d].maxblk;
+    }
+    logMessage(LcDriverLLevel, "Set up block metadata of device %d (%zu blocks)", devinfo[d].did, nblk);
+    return 0;
+}
 
-void findsamefileblock(int n, LcFHandle fh){ //argument = readnow 
-    int i,j;
-    n = 0;
-    // filepos/256 == fblknum 
-    // fblknum = everytime offset + writebytes >= 256, counter++ -> fblknum[sec][blk]
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : allocrun
+// Description  : allocate up to n consecutive device blocks (lcloud_allocrun)
+//                on a device whose storage index is not set in the avoid
+//                mask (replicas go on devices without another copy)
 
+int allocrun(LcFHandle fh, uint32_t fblk, int n, uint32_t avoid, int *dev, int *sec, int *blk){
+    int tries, d, i, j, run, start, beststart = -1, bestrun = 0, bestdev = -1;
 
-    do{
-        for(i=0; i<devinfo[n].maxsec; i++){
-            for(j=0; j<devinfo[n].maxblk; j++){
-                if(devinfo[n].fileblktracker[i][j] == fh && devinfo[n].filepostracker[i][j]/256 == finfo[fh].pos/256){
-                    devinfo[n].rsec = i;
-                    devinfo[n].rblk = j;
-                    readnow = n;
-                    return ;
+    for(tries=0, d=placedevice(); tries<devicenum && bestrun<n; tries++, nextdevice(&d)){
+        if((avoid & (1u << d)) || devmeta(d)){
+            continue;
+        }
+        run = 0;
+        start = 0;
+        for(i=0; i<devinfo[d].maxsec && bestrun<n; i++){
+            for(j=0; j<devinfo[d].maxblk && bestrun<n; j++){
+                if(devinfo[d].storage[i][j] != 0){
+                    run = 0;
+                    continue;
+                }
+                if(run++ == 0){
+                    start = i * devinfo[d].maxblk + j;
                 }
+                if(run > bestrun){
+                    bestrun = run;
+                    beststart = start;
+                    bestdev = d;
+                }
+            }
+        }
+    }
+    if(bestrun == 0){
+        *dev = -1;
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate block: all devices are full");
+        return( -1 );
+    }
+
+    if(avoid == 0){
+        now = bestdev;
+    }
+    *dev = bestdev;
+    *sec = beststart / devinfo[bestdev].maxblk;
+    *blk = beststart % devinfo[bestdev].maxblk;
+    for(i=beststart; i<beststart+bestrun; i++){
+        devinfo[bestdev].storage[i / devinfo[bestdev].maxblk][i % devinfo[bestdev].maxblk] = 1;
+        devinfo[bestdev].fileblktracker[i / devinfo[bestdev].maxblk][i % devinfo[bestdev].maxblk] = fh;  // block remembers which file wrote on it
+        devinfo[bestdev].filepostracker[i / devinfo[bestdev].maxblk][i % devinfo[bestdev].maxblk] = fblk + (i - beststart);
+    }
+    placecharge(bestdev, bestrun);
+    devinfo[bestdev].nfree -= bestrun;
+    fsstats.devices[bestdev].free = devinfo[bestdev].nfree;
+    allocatedblock += bestrun;
+    fsstats.allocations += bestrun;
+    fsstats.allocruns++;
+    fsstats.devices[bestdev].allocated += bestrun;
+    logMessage(LOG_INFO_LEVEL, "Allocated block %d out of %d (%0.2f%%)", allocatedblock, totalblock, 100.0*(float)allocatedblock/(float)totalblock);
+    logMessage(LcDriverLLevel, "Allocated %d blocks for data at [%d/%d/%d]", bestrun, devinfo[bestdev].did, *sec, *blk);
+    return( bestrun );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : allocspread
+// Description  : allocrun on the device (not in avoid) with the most free
+//                blocks, so stripes that must land on distinct devices
+//                keep as many devices open as long as possible
+
+int allocspread(LcFHandle fh, uint32_t fblk, int n, uint32_t avoid, int *dev, int *sec, int *blk){
+    int d, best = -1;
+
+    for(d=0; d<devicenum; d++){
+        if((avoid & (1u << d)) == 0 && devinfo[d].nfree > 0 && (best == -1 || devinfo[d].nfree > devinfo[best].nfree)){
+            best = d;
+        }
+    }
+    if(best == -1){
+        return allocrun(fh, fblk, n, avoid, dev, sec, blk);
+    }
+    return allocrun(fh, fblk, n, ((1u << devicenum) - 1) & ~(1u << best), dev, sec, blk);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : iszero
+// Description  : check if a block is all zeros
+
+bool iszero(const char *buf){
+    uint64_t w, acc = 0;
+    int i;
+
+    for(i=0; i<LC_DEVICE_BLOCK_SIZE; i+=sizeof(w)){
+        memcpy(&w, &buf[i], sizeof(w));
+        acc |= w;
+    }
+    return (acc == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mirrorfree
+//
+// Input        : fh, fblk, from
+//
+// Description  : give back the replicas from..end of a file block (and drop
+//                them from the cache).
+//
+
+void mirrorfree(LcFHandle fh, uint32_t fblk, int from){
+    LcCacheAddr drop;
+    blkaddr *addr;
+    int r;
+
+    for(r=from; r<LC_MAX_COPIES-1; r++){
+        if(finfo[fh].mirror[r] == NULL || fblk >= (uint32_t)finfo[fh].mapsize){
+            continue;
+        }
+        addr = &finfo[fh].mirror[r][fblk];
+        if(addr->dev >= 0){
+            lcloud_freeblk(addr->dev, addr->sec, addr->blk);
+            drop.did = devinfo[addr->dev].did;
+            drop.sec = addr->sec;
+            drop.blk = addr->blk;
+            lcloud_cacheinvalidate(&drop, 1);
+            addr->dev = BLK_UNALLOCATED;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : punchblock
+//
+// Input        : fh, fblk
+//
+// Description  : turn a file block written as all zeros into a hole, giving
+//                its device block (unless it is still shared) and its
+//                replicas back.
+//
+
+int punchblock(LcFHandle fh, uint32_t fblk){
+    blkaddr *addr = &finfo[fh].blkmap[fblk];
+
+    mirrorfree(fh, fblk, 0);
+    if(addr->dev >= 0 && lcdedup_release(addr->dev, addr->sec, addr->blk) == 0 &&
+       lcloud_freeblk(addr->dev, addr->sec, addr->blk)){
+        return -1;
+    }
+    addr->dev = BLK_UNALLOCATED;
+    fsstats.zeroholes++;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : growmap
+// Description  : grow a block map from size to newsize entries (the new ones unallocated)
+
+int growmap(blkaddr **map, int size, int newsize){
+    blkaddr *newmap;
+    int i;
+
+    if((newmap = (blkaddr *)realloc(*map, sizeof(blkaddr) * newsize)) == NULL){
+        return -1;
+    }
+    for(i=size; i<newsize; i++){
+        newmap[i].dev = BLK_UNALLOCATED;
+    }
+    *map = newmap;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getfileblk
+// Description  : get the block map entry of a file block, growing the map as needed
+//
+// Inputs       : fh, fblk - file block number (filepos/256)
+// Outputs      : map entry, NULL if failure
+
+blkaddr *getfileblk(LcFHandle fh, int fblk){
+    int r, newsize;
 
+    if(fblk >= finfo[fh].mapsize){
+        newsize = (finfo[fh].mapsize == 0) ? 16 : finfo[fh].mapsize;
+        while(newsize <= fblk){
+            newsize *= 2;
+        }
+        if(growmap(&finfo[fh].blkmap, finfo[fh].mapsize, newsize)){
+            logMessage(LOG_ERROR_LEVEL, "Failed to grow block map of file %s", finfo[fh].fname);
+            return NULL;
+        }
+        for(r=0; r<finfo[fh].copies-1; r++){
+            if(growmap(&finfo[fh].mirror[r], finfo[fh].mapsize, newsize)){
+                logMessage(LOG_ERROR_LEVEL, "Failed to grow replica map of file %s", finfo[fh].fname);
+                return NULL;
             }
         }
-    }while(n<devicenum);
+        if(finfo[fh].unit > 0 && growmap(&finfo[fh].parity, finfo[fh].mapsize, newsize)){
+            logMessage(LOG_ERROR_LEVEL, "Failed to grow parity map of file %s", finfo[fh].fname);
+            return NULL;
+        }
+        finfo[fh].mapsize = newsize;
+    }
+    return &finfo[fh].blkmap[fblk];
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : findsamefileblock (for write)
-// Description  : find same file block for overwriting
+// Function     : growclusters
+// Description  : grow a file's cluster map to hold cluster c
 
-void wfindsamefileblock(int n, LcFHandle fh){ //argument = now 
-    int i,j;
-    n = 0;
+int growclusters(LcFHandle fh, uint32_t c){
+    int newsize;
 
-    do{
-        for(i=0; i<devinfo[n].maxsec; i++){
-            for(j=0; j<devinfo[n].maxblk; j++){
-                if(devinfo[n].fileblktracker[i][j] == fh && devinfo[n].filepostracker[i][j]/256 == finfo[fh].pos/256 && devinfo[n].storage[i][j] > 0){
-                    devinfo[n].sec = i;
-                    devinfo[n].blk = j;
-                    now = n;
-                    return ;
-                }
+    if(c >= (uint32_t)finfo[fh].clmapsize){
+        newsize = (finfo[fh].clmapsize == 0) ? 4 : finfo[fh].clmapsize;
+        while((uint32_t)newsize <= c){
+            newsize *= 2;
+        }
+        if(growmap(&finfo[fh].clmap, finfo[fh].clmapsize, newsize)){
+            logMessage(LOG_ERROR_LEVEL, "Failed to grow cluster map of file %s", finfo[fh].fname);
+            return -1;
+        }
+        finfo[fh].clmapsize = newsize;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clusterslot
+// Description  : check if device block i (sector * maxblk + block) of a
+//                device can take file block fblk: free, or reserved for it
+
+bool clusterslot(int d, int i, LcFHandle fh, uint32_t fblk){
+    int sec = i / devinfo[d].maxblk, blk = i % devinfo[d].maxblk;
+
+    return devinfo[d].storage[sec][blk] == 0 ||
+        (devinfo[d].storage[sec][blk] == BLK_RESERVED && devinfo[d].fileblktracker[sec][blk] == fh &&
+         devinfo[d].filepostracker[sec][blk] == fblk);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : claimblocks
+// Description  : allocate n device blocks from block i of a device (free or
+//                reserved ones, see clusterslot) to consecutive file blocks
+
+void claimblocks(int d, int i, int n, LcFHandle fh, uint32_t fblk){
+    int j, sec, blk;
+
+    for(j=0; j<n; j++){
+        sec = (i + j) / devinfo[d].maxblk;
+        blk = (i + j) % devinfo[d].maxblk;
+        if(devinfo[d].storage[sec][blk] == 0){
+            devinfo[d].nfree--;
+        }
+        else{
+            fsstats.clusterreserved--;
+        }
+        devinfo[d].storage[sec][blk] = 1;
+        devinfo[d].fileblktracker[sec][blk] = fh;
+        devinfo[d].filepostracker[sec][blk] = fblk + j;
+    }
+    fsstats.devices[d].free = devinfo[d].nfree;
+    allocatedblock += n;
+    fsstats.allocations += n;
+    fsstats.devices[d].allocated += n;
+    logMessage(LcDriverLLevel, "Allocated %d blocks for data at [%d/%d/%d]", n, devinfo[d].did,
+               i / devinfo[d].maxblk, i % devinfo[d].maxblk);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unreserve
+// Description  : give back the still reserved blocks of a file's cluster c
+//                that belong to file blocks from on (and forget the cluster
+//                if all of it goes)
+
+void unreserve(LcFHandle fh, uint32_t c, uint32_t from){
+    blkaddr *base = &finfo[fh].clmap[c];
+    uint32_t fblk;
+    int o, i, d = base->dev;
+
+    if(d < 0){
+        return;
+    }
+    for(o=0; o<clusterblks; o++){
+        fblk = c * clusterblks + o;
+        i = base->sec * devinfo[d].maxblk + base->blk + o;
+        if(fblk >= from && devinfo[d].storage[i / devinfo[d].maxblk][i % devinfo[d].maxblk] == BLK_RESERVED &&
+           clusterslot(d, i, fh, fblk)){
+            devinfo[d].storage[i / devinfo[d].maxblk][i % devinfo[d].maxblk] = 0;
+            devinfo[d].fileblktracker[i / devinfo[d].maxblk][i % devinfo[d].maxblk] = 0;
+            devinfo[d].filepostracker[i / devinfo[d].maxblk][i % devinfo[d].maxblk] = 0;
+            devinfo[d].nfree++;
+            fsstats.clusterreserved--;
+        }
+    }
+    fsstats.devices[d].free = devinfo[d].nfree;
+    if(from <= c * clusterblks){
+        base->dev = BLK_UNALLOCATED;
+    }
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : allocclusters
+// Description  : reserve up to nc consecutive whole free clusters (aligned
+//                runs of clusterblks device blocks) for clusters c.. of a
+//                file, on a device not in the avoid mask.  Returns the
+//                clusters reserved, 0 if no device has a free cluster.
+
+int allocclusters(LcFHandle fh, uint32_t c, int nc, uint32_t avoid){
+    int tries, d, i, j, run, start = 0, beststart = -1, bestrun = 0, bestdev = -1;
+
+    for(tries=0, d=placedevice(); tries<devicenum && bestrun<nc; tries++, nextdevice(&d)){
+        if((avoid & (1u << d)) || devmeta(d)){
+            continue;
+        }
+        run = 0;
+        for(i=0; i+clusterblks<=devinfo[d].maxsec*devinfo[d].maxblk && bestrun<nc; i+=clusterblks){
+            for(j=0; j<clusterblks && devinfo[d].storage[(i+j) / devinfo[d].maxblk][(i+j) % devinfo[d].maxblk] == 0; j++);
+            if(j < clusterblks){
+                run = 0;
+                continue;
+            }
+            if(run++ == 0){
+                start = i;
+            }
+            if(run > bestrun){
+                bestrun = run;
+                beststart = start;
+                bestdev = d;
             }
         }
-    }while(n<devicenum);
+    }
+    if(bestrun == 0){
+        return 0;
+    }
+
+    if(avoid == 0){
+        now = bestdev;
+    }
+    for(j=0; j<bestrun; j++){
+        unreserve(fh, c + j, 0);
+        finfo[fh].clmap[c + j].dev = bestdev;
+        finfo[fh].clmap[c + j].sec = (beststart + j * clusterblks) / devinfo[bestdev].maxblk;
+        finfo[fh].clmap[c + j].blk = (beststart + j * clusterblks) % devinfo[bestdev].maxblk;
+    }
+    for(i=beststart; i<beststart+bestrun*clusterblks; i++){
+        devinfo[bestdev].storage[i / devinfo[bestdev].maxblk][i % devinfo[bestdev].maxblk] = BLK_RESERVED;
+        devinfo[bestdev].fileblktracker[i / devinfo[bestdev].maxblk][i % devinfo[bestdev].maxblk] = fh;
+        devinfo[bestdev].filepostracker[i / devinfo[bestdev].maxblk][i % devinfo[bestdev].maxblk] = c * clusterblks + (i - beststart);
+    }
+    placecharge(bestdev, bestrun * clusterblks);
+    devinfo[bestdev].nfree -= bestrun * clusterblks;
+    fsstats.devices[bestdev].free = devinfo[bestdev].nfree;
+    fsstats.clusterreserved += bestrun * clusterblks;
+    fsstats.clusterallocs += bestrun;
+    fsstats.allocruns++;
+    return bestrun;
 }
+
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : nextdevice
-// Description  : move onto next device
+// Function     : allocdata
+// Description  : allocate up to n consecutive device blocks for consecutive
+//                data blocks of a file.  With a cluster size (lccluster)
+//                the blocks take their slots in the file's clusters, and
+//                only a block whose cluster is not held (or whose slot was
+//                taken) reserves new clusters; once no whole cluster is
+//                free the blocks are allocated one run at a time again.
+//                Parity files spread their stripe units (allocspread).
+
+int allocdata(LcFHandle fh, uint32_t fblk, int n, uint32_t avoid, int *dev, int *sec, int *blk){
+    uint32_t c = fblk / clusterblks;
+    int o = fblk % clusterblks, got, d, i;
+    blkaddr *cl;
+
+    if(clusterblks == 1 || finfo[fh].unit > 0){
+        return (finfo[fh].unit > 0) ? allocspread(fh, fblk, n, avoid, dev, sec, blk)
+                                    : allocrun(fh, fblk, n, avoid, dev, sec, blk);
+    }
+    if(growclusters(fh, (fblk + n - 1) / clusterblks)){
+        return -1;
+    }
 
-void nextdevice(int *n){
-    if(*n>=devicenum-1){
-        *n=0;
+    //the rest of the cluster the file holds, as long as its slots are free
+    if((d = finfo[fh].clmap[c].dev) < 0 || (avoid & (1u << d)) != 0 ||
+       !clusterslot(d, finfo[fh].clmap[c].sec * devinfo[d].maxblk + finfo[fh].clmap[c].blk + o, fh, fblk)){
+        //new clusters for this block on (an unusable one is given back)
+        if(allocclusters(fh, c, (o + n + clusterblks - 1) / clusterblks, avoid) == 0){
+            return allocrun(fh, fblk, n, avoid, dev, sec, blk);
+        }
+        d = finfo[fh].clmap[c].dev;
     }
     else{
-        (*n)++;
+        fsstats.clusterhits++;
+    }
+    //as far as the slots run on consecutively (the clusters of one reservation do)
+    i = finfo[fh].clmap[c].sec * devinfo[d].maxblk + finfo[fh].clmap[c].blk + o;
+    for(got=0; got<n; got++){
+        cl = &finfo[fh].clmap[(fblk + got) / clusterblks];
+        if(cl->dev != d || cl->sec * devinfo[d].maxblk + cl->blk + (int)((fblk + got) % clusterblks) != i + got ||
+           !clusterslot(d, i + got, fh, fblk + got)){
+            break;
+        }
     }
+    claimblocks(d, i, got, fh, fblk);
+    *dev = d;
+    *sec = i / devinfo[d].maxblk;
+    *blk = i % devinfo[d].maxblk;
+    return got;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -204,6 +742,29 @@ uint64_t extract_lcloud_registers(LCloudRegisterFrame resp, uint64_t *b0, uint64
     return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : io_bus
+// Description  : send the frame over the bus, counting and timing the transaction by opcode
+//
+// Inputs       : frm, *xfer
+// Outputs      : response frame from the bus
+
+LCloudRegisterFrame io_bus(LCloudRegisterFrame frm, void *xfer){
+    uint64_t op = (frm >> 48) & 0xff;
+    uint64_t tstart = lchist_now();
+    LCloudRegisterFrame resp;
+
+    resp = lcloud_io_bus(frm, xfer);
+
+    fsstats.bustransactions++;
+    if(op < LC_STATS_MAXBUSOPS){
+        fsstats.busops[op]++;
+        lchist_record(LC_HIST_BUS_POWER_ON + op, tstart);
+    }
+    return resp;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : probeID
@@ -228,6 +789,37 @@ uint8_t probeID(uint16_t id0){
     return count-1;  //shifted amount -1 will be device id
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : deverror
+// Description  : count a failed transfer against a device
+
+void deverror(int did){
+    int n;
+
+    if((n = devindex(did)) >= 0){
+        devinfo[n].errors++;
+        devinfo[n].goodxfers = 0;
+        fsstats.devices[n].errors++;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : devrecover
+// Description  : count a successful transfer for a device (storage index):
+//                every LC_DEVICE_RECOVERXFERS in a row work off one failed
+//                transfer, so a device that recovers gets its reads back
+
+void devrecover(int n){
+    if(devinfo[n].errors > 0 && ++devinfo[n].goodxfers == LC_DEVICE_RECOVERXFERS){
+        devinfo[n].goodxfers = 0;
+        if(--devinfo[n].errors == 0){
+            logMessage(LcDriverLLevel, "Device %d has recovered from its failed transfers", devinfo[n].did);
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : do_read
@@ -239,14 +831,21 @@ uint8_t probeID(uint16_t id0){
 //
 
 int do_read(int did, int sec, int blk, char *buf){
+    int n;
 
     frm = create_lcloud_registers(0, 0 ,LC_BLOCK_XFER ,did, LC_XFER_READ, sec, blk); 
 
-    if( (frm == -1) || ((rfrm = lcloud_io_bus(frm, buf)) == -1) || 
+    if( (frm == -1) || ((rfrm = io_bus(frm, buf)) == -1) || 
     (extract_lcloud_registers(rfrm, &b0, &b1, &c0, &c1, &c2, &d0, &d1)) || (b0 != 1) || (b1 != 1) || (c0 != LC_BLOCK_XFER)){
         logMessage(LOG_ERROR_LEVEL, "LC failure reading blkc [%d/%d/%d].", did, sec, blk);
+        deverror(did);
         return(-1);
     }
+    if((n = devindex(did)) >= 0){
+        fsstats.devices[n].reads++;
+        fsstats.devices[n].bytesread += LC_DEVICE_BLOCK_SIZE;
+        devrecover(n);
+    }
     logMessage(LcDriverLLevel, "LC success reading blkc [%d/%d/%d].", did, sec, blk);
     return 0;
 }
@@ -262,68 +861,1611 @@ int do_read(int did, int sec, int blk, char *buf){
 //
 
 int do_write(int did, int sec, int blk, char *buf){
+    int n;
 
     frm = create_lcloud_registers(0, 0 ,LC_BLOCK_XFER ,did, LC_XFER_WRITE, sec, blk);  
 
-    if( (frm == -1) || ((rfrm = lcloud_io_bus(frm, buf)) == -1) ||   
+    if( (frm == -1) || ((rfrm = io_bus(frm, buf)) == -1) ||   
     (extract_lcloud_registers(rfrm, &b0, &b1, &c0, &c1, &c2, &d0, &d1)) || (b0 != 1) || (b1 != 1) || (c0 != LC_BLOCK_XFER)){ 
         logMessage(LOG_ERROR_LEVEL, "LC failure writing blkc [%d/%d/%d].", did, sec, blk);
+        deverror(did);
         return(-1);
     }
+    if((n = devindex(did)) >= 0){
+        fsstats.devices[n].writes++;
+        fsstats.devices[n].byteswritten += LC_DEVICE_BLOCK_SIZE;
+        devrecover(n);
+    }
     logMessage(LcDriverLLevel, "LC success writing blkc [%d/%d/%d].", did, sec, blk);
     return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : lcpoweron
+// Function     : sched_xfer
 //
-// Description  : power on the device 
-//                  
-//                b0/b1 - which direction / return status
-//                c0    - Operation code (poweron/off/probe/transfer)
-//                c1    - device id
-//                c2    - read(0)/write(1)
-//                d0/d1 - sector/block
+// Input        : dir, did, sec, blk, *buf
+//
+// Description  : transfer function for the I/O scheduler: blocks read from
+//                the device are cached on the way in.
 //
 
-int32_t lcpoweron(void){
-    int i,j;
-    int fd;
-    int reserved0;
-
-    // cache init
-    lcloud_initcache(LC_CACHE_MAXBLOCKS);
-
-    logMessage(LcControllerLLevel, "Initialzing Lion Cloud system ...");
+int sched_xfer(int dir, LcDeviceId did, int sec, int blk, char *buf){
+    if(dir == LC_XFER_WRITE){
+        return do_write(did, sec, blk, buf);
+    }
+    if(do_read(did, sec, blk, buf)){
+        return -1;
+    }
+    lcloud_putcache(did, sec, blk, buf);
+    return 0;
+}
 
-    // Do Operation - PowerOn
-    frm = create_lcloud_registers(0, 0 ,LC_POWER_ON ,0, 0, 0, 0); 
-    rfrm = lcloud_io_bus(frm, NULL);
-    extract_lcloud_registers(rfrm, &b0, &b1, &c0, &c1, &c2, &d0, &d1);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : prefetchblk
+//
+// Input        : did, sec, blk
+//
+// Description  : cache snapshot fetch: queue a read of a device block so it
+//                is cached when the queues run (the data itself is dropped).
+//                Only blocks a file holds are read: a free block's contents
+//                are stale, and caching them would hand them to the next
+//                allocation of the block.
+//
 
-    isDeviceOn = true;
-    bool first = true; //check if is calling probeID first time
+int prefetchblk(LcDeviceId did, uint16_t sec, uint16_t blk){
+    static char scratch[LC_DEVICE_BLOCK_SIZE];
+    int n;
 
-    int n=0; //devinit loop counter
-    
-    devinfo = (device *)malloc(sizeof(device) * devicenum);
-    for(i=0; i<devicenum; i++){
-        devinfo[i].did = 0;
-        devinfo[i].sec = 0;
-        devinfo[i].blk = 0;
-        devinfo[i].rsec = 0;
-        devinfo[i].rblk = 0;
-        devinfo[i].maxsec = 0;
-        devinfo[i].maxblk = 0;
-        devinfo[i].numwritten = 0;
-        devinfo[i].devwritten = 0;
-        devinfo[i].devread = 0;
+    if((n = devindex(did)) < 0 || sec >= devinfo[n].maxsec || blk >= devinfo[n].maxblk ||
+       devinfo[n].storage == NULL || devinfo[n].storage[sec][blk] != 1){
+        return -1;
     }
+    return (lcsched_read(did, sec, blk, scratch, 0, LC_DEVICE_BLOCK_SIZE, NULL) == -1) ? -1 : 0;
+}
 
-    // Do Operation - Devprobe
-    frm = create_lcloud_registers(0, 0 ,LC_DEVPROBE ,0, 0, 0, 0); 
-    rfrm = lcloud_io_bus(frm, NULL);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readcluster
+//
+// Input        : fh, fblk, hi
+//
+// Description  : a sequential read of a file block missed the cache: queue
+//                the reads (into the cache) of the rest of its cluster past
+//                file block hi (the end of the read), as far as the blocks
+//                are still in their slots and not cached, and no more than
+//                1/LC_CLUSTER_READSHARE of the cache (a small cache would
+//                evict them before they are read).
+//
+
+int readcluster(LcFHandle fh, uint32_t fblk, uint32_t hi){
+    uint32_t c = fblk / clusterblks, f;
+    blkaddr *base, *addr;
+    LcCacheStats cache;
+    LcDeviceId did;
+    int o, left;
+
+    if(clusterblks == 1 || c >= (uint32_t)finfo[fh].clmapsize || (base = &finfo[fh].clmap[c])->dev < 0){
+        return 0;
+    }
+    lcloud_cachestats(&cache);
+    left = cache.maxitems / LC_CLUSTER_READSHARE;
+    did = devinfo[base->dev].did;
+    for(o=0; o<clusterblks && left>0; o++){
+        f = c * clusterblks + o;
+        if(f <= hi || f >= (uint32_t)finfo[fh].mapsize){
+            continue;
+        }
+        addr = &finfo[fh].blkmap[f];
+        if(addr->dev != base->dev || addr->sec * devinfo[base->dev].maxblk + addr->blk !=
+           base->sec * devinfo[base->dev].maxblk + base->blk + o || findcache(did, addr->sec, addr->blk) != -1){
+            continue;
+        }
+        if(prefetchblk(did, addr->sec, addr->blk)){
+            return -1;
+        }
+        fsstats.clusterreads++;
+        left--;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readcopy
+//
+// Input        : fh, fblk
+//
+// Description  : pick the copy of a placed file block to read: a cached
+//                one, else the one on the least busy device, preferring
+//                devices without recent failed transfers (see devrecover).
+//
+
+blkaddr *readcopy(LcFHandle fh, uint32_t fblk){
+    blkaddr *best = &finfo[fh].blkmap[fblk], *addr;
+    int r, i, n;
+
+    if(finfo[fh].copies == 1){
+        return best;
+    }
+    for(i=-1; i<finfo[fh].copies-1; i++){
+        addr = (i < 0) ? best : &finfo[fh].mirror[i][fblk];
+        if(addr->dev >= 0 && findcache(devinfo[addr->dev].did, addr->sec, addr->blk) >= 0){
+            return addr;
+        }
+    }
+    for(r=0; r<finfo[fh].copies-1; r++){
+        addr = &finfo[fh].mirror[r][fblk];
+        if(addr->dev < 0){
+            continue;
+        }
+        n = best->dev;
+        if((devinfo[addr->dev].errors == 0) != (devinfo[n].errors == 0) ? devinfo[addr->dev].errors == 0 :
+           lcsched_depth(devinfo[addr->dev].did) < lcsched_depth(devinfo[n].did)){
+            best = addr;
+        }
+    }
+    if(best != &finfo[fh].blkmap[fblk]){
+        fsstats.mirrorreads++;
+    }
+    return best;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mirrormask
+// Description  : the devices (storage index bits) holding replicas of a file block
+
+uint32_t mirrormask(LcFHandle fh, uint32_t fblk){
+    uint32_t mask = 0;
+    int r;
+
+    for(r=0; r<finfo[fh].copies-1; r++){
+        if(finfo[fh].mirror[r][fblk].dev >= 0){
+            mask |= 1u << finfo[fh].mirror[r][fblk].dev;
+        }
+    }
+    return mask;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mirrorwrite
+//
+// Input        : fh, fblk, *data
+//
+// Description  : queue the writes of the replicas of a placed file block
+//                (with the write of the block itself, so all the copies go
+//                out to their devices together), placing missing replicas
+//                on devices holding no other copy of the block.
+//
+
+int mirrorwrite(LcFHandle fh, uint32_t fblk, const char *data){
+    LcCacheAddr stale;
+    uint32_t avoid;
+    blkaddr *addr;
+    int r;
+
+    for(r=0; r<finfo[fh].copies-1; r++){
+        addr = &finfo[fh].mirror[r][fblk];
+        if(addr->dev < 0){
+            avoid = (1u << finfo[fh].blkmap[fblk].dev) | mirrormask(fh, fblk);
+            if(allocrun(fh, fblk, 1, avoid, &addr->dev, &addr->sec, &addr->blk) != 1){
+                logMessage(LOG_ERROR_LEVEL, "Failed to place copy %d of block %d of file %s", r+2, fblk, finfo[fh].fname);
+                addr->dev = BLK_UNALLOCATED;
+                return -1;
+            }
+        }
+        //a cached copy of the old contents (of the replica, or of whatever
+        //the newly allocated block held before)
+        stale.did = devinfo[addr->dev].did;
+        stale.sec = addr->sec;
+        stale.blk = addr->blk;
+        lcloud_cacheinvalidate(&stale, 1);
+        if(lcsched_write(devinfo[addr->dev].did, addr->sec, addr->blk, data)){
+            return -1;
+        }
+        fsstats.mirrorwrites++;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queueblock
+//
+// Input        : *addr, *buf, off, len, *err
+//
+// Description  : get bytes off..off+len of a device block into buf, from the
+//                cache if it is there, otherwise through the I/O scheduler.
+//                Returns 1 if a device read was queued (buf is filled when
+//                the queues are next run, or *err set if the read fails),
+//                0 if buf is filled, -1 if failure.
+//
+
+int queueblock(blkaddr *addr, char *buf, int off, int len, int *err){
+    char *cached;
+    LcDeviceId did = devinfo[addr->dev].did;
+    int ret;
+
+    if((cached = lcloud_getcache(did, addr->sec, addr->blk)) != NULL){
+        memcpy(buf, cached+off, len);
+        return 0;
+    }
+    if((ret = lcsched_read(did, addr->sec, addr->blk, buf, off, len, err)) == -1){
+        return -1;
+    }
+    return (ret == 0) ? 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getblock
+//
+// Input        : *addr, *buf
+//
+// Description  : get the contents of a device block, from the cache if it is
+//                there, otherwise from the device (and then cache it).
+//
+
+int getblock(blkaddr *addr, char *buf){
+    int ret, err = 0;
+
+    if((ret = queueblock(addr, buf, 0, LC_DEVICE_BLOCK_SIZE, &err)) == 1){
+        lcsched_run(0);
+        ret = err;
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripeblk
+// Description  : file block o of data unit u of a parity stripe
+
+uint32_t stripeblk(LcFHandle fh, uint32_t stripe, int u, int o){
+    return (stripe * finfo[fh].width + u) * finfo[fh].unit + o;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : striperow
+// Description  : parity row of a file block (stripe * unit + block in its unit)
+
+uint32_t striperow(LcFHandle fh, uint32_t fblk){
+    return fblk / (finfo[fh].unit * finfo[fh].width) * finfo[fh].unit + fblk % finfo[fh].unit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripedata
+// Description  : the devices (storage index bits) holding the data units of
+//                a stripe, except unit skip (-1 for none)
+
+uint32_t stripedata(LcFHandle fh, uint32_t stripe, int skip){
+    uint32_t mask = 0, fblk;
+    int u, o;
+
+    for(u=0; u<finfo[fh].width; u++){
+        for(o=0; o<finfo[fh].unit && u != skip; o++){
+            fblk = stripeblk(fh, stripe, u, o);
+            if(fblk < (uint32_t)finfo[fh].mapsize && finfo[fh].blkmap[fblk].dev >= 0){
+                mask |= 1u << finfo[fh].blkmap[fblk].dev;
+            }
+        }
+    }
+    return mask;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : paritydev
+// Description  : the device of a stripe's parity: where its placed parity
+//                blocks are, else the one the parity rotates to (stripe
+//                modulo the devices)
+
+int paritydev(LcFHandle fh, uint32_t stripe){
+    uint32_t row;
+    int o;
+
+    for(o=0; o<finfo[fh].unit; o++){
+        row = stripe * finfo[fh].unit + o;
+        if(row < (uint32_t)finfo[fh].mapsize && finfo[fh].parity[row].dev >= 0){
+            return finfo[fh].parity[row].dev;
+        }
+    }
+    return stripe % devicenum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripemask
+// Description  : the devices a block of data unit u of a stripe must stay
+//                off: those of the other data units and of the parity
+
+uint32_t stripemask(LcFHandle fh, uint32_t stripe, int u){
+    int pdev = paritydev(fh, stripe);
+    uint32_t mask = stripedata(fh, stripe, u);
+
+    //(a full rotation device is given up, the parity goes elsewhere)
+    if(devinfo[pdev].nfree >= finfo[fh].unit || (mask & (1u << pdev)) == 0){
+        mask |= 1u << pdev;
+    }
+    return mask;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : rowblock
+//
+// Input        : fh, fblk, *data, **src, *err
+//
+// Description  : get a data block of a parity row: holes are zeros, delayed
+//                blocks come from their slot, placed ones from the cache or
+//                the device.  *src is set to the contents, the return value
+//                is that of queueblock (1 if a device read was queued).
+//
+
+int rowblock(LcFHandle fh, uint32_t fblk, char *data, const char **src, int *err){
+    blkaddr *addr = (fblk < (uint32_t)finfo[fh].mapsize) ? &finfo[fh].blkmap[fblk] : NULL;
+
+    *src = data;
+    if(addr == NULL || addr->dev == BLK_UNALLOCATED){
+        memset(data, 0x0, LC_DEVICE_BLOCK_SIZE);
+        return 0;
+    }
+    if(addr->dev == BLK_DELAYED){
+        *src = finfo[fh].delayed[addr->sec].data;
+        return 0;
+    }
+    return queueblock(addr, data, 0, LC_DEVICE_BLOCK_SIZE, err);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : parityrow
+//
+// Input        : fh, row, *known[]
+//
+// Description  : recompute and write the parity block of a stripe row.  The
+//                data units given in known (just written) are used as they
+//                are and only the others are read, so a row written whole
+//                (full stripe write) costs no reads.  The parity block is
+//                placed on the stripe's parity device when it is new.
+//
+
+int parityrow(LcFHandle fh, uint32_t row, const char *known[LC_PARITY_MAXWIDTH]){
+    char data[LC_PARITY_MAXWIDTH][LC_DEVICE_BLOCK_SIZE], parity[LC_DEVICE_BLOCK_SIZE];
+    const char *src[LC_PARITY_MAXWIDTH];
+    uint32_t stripe = row / finfo[fh].unit, all = (1u << devicenum) - 1, avoid;
+    blkaddr *addr = &finfo[fh].parity[row];
+    LcCacheAddr stale;
+    int u, ret, want, queued = 0, reads = 0, err = 0;
+
+    for(u=0; u<finfo[fh].width; u++){
+        if(known != NULL && known[u] != NULL){
+            src[u] = known[u];
+            continue;
+        }
+        if((ret = rowblock(fh, stripeblk(fh, stripe, u, row % finfo[fh].unit), data[u], &src[u], &err)) == -1){
+            lcsched_cancel((char *)data, sizeof(data));
+            return -1;
+        }
+        queued += ret;
+        reads++;
+    }
+    if(queued > 0){
+        lcsched_run(0);
+    }
+    if(err){
+        return -1;
+    }
+    lcparity_xor(parity, src, finfo[fh].width, LC_DEVICE_BLOCK_SIZE);
+    if(reads == 0){
+        fsstats.parityfull++;
+    }
+    else{
+        fsstats.paritypartial++;
+    }
+
+    if(addr->dev < 0){
+        avoid = stripedata(fh, stripe, -1);
+        want = paritydev(fh, stripe);
+        if(((avoid & (1u << want)) != 0 || devinfo[want].nfree == 0 ||
+            allocrun(fh, row, 1, all & ~(1u << want), &addr->dev, &addr->sec, &addr->blk) != 1) &&
+           allocspread(fh, row, 1, avoid, &addr->dev, &addr->sec, &addr->blk) != 1){
+            logMessage(LOG_ERROR_LEVEL, "Failed to place parity row %d of file %s", row, finfo[fh].fname);
+            addr->dev = BLK_UNALLOCATED;
+            return -1;
+        }
+    }
+    //(a new parity block may have a cached copy of what it held before)
+    stale.did = devinfo[addr->dev].did;
+    stale.sec = addr->sec;
+    stale.blk = addr->blk;
+    lcloud_cacheinvalidate(&stale, 1);
+    if(lcsched_write(devinfo[addr->dev].did, addr->sec, addr->blk, parity)){
+        return -1;
+    }
+    fsstats.paritywrites++;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : paritywrite
+//
+// Input        : fh, fblk, *data
+//
+// Description  : update the parity of a placed block just (re)written
+//                (nothing to do for files without parity).
+//
+
+int paritywrite(LcFHandle fh, uint32_t fblk, const char *data){
+    const char *known[LC_PARITY_MAXWIDTH] = { NULL };
+
+    if(finfo[fh].unit == 0){
+        return 0;
+    }
+    known[(fblk / finfo[fh].unit) % finfo[fh].width] = data;
+    return parityrow(fh, striperow(fh, fblk), known);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : paritybuild
+//
+// Input        : fh, fblk, *buf
+//
+// Description  : degraded read: rebuild a placed block from its row's parity
+//                and the other data units, without touching its device.
+//
+
+int paritybuild(LcFHandle fh, uint32_t fblk, char *buf){
+    char data[LC_PARITY_MAXWIDTH][LC_DEVICE_BLOCK_SIZE];
+    const char *src[LC_PARITY_MAXWIDTH];
+    uint32_t row = striperow(fh, fblk), stripe = row / finfo[fh].unit;
+    int u, v, ret, queued = 0, err = 0, skip = (fblk / finfo[fh].unit) % finfo[fh].width;
+
+    if(finfo[fh].parity[row].dev < 0 ||
+       (ret = queueblock(&finfo[fh].parity[row], data[0], 0, LC_DEVICE_BLOCK_SIZE, &err)) == -1){
+        return -1;
+    }
+    src[0] = data[0];
+    queued += ret;
+    for(u=0, v=1; u<finfo[fh].width; u++){
+        if(u == skip){
+            continue;
+        }
+        if((ret = rowblock(fh, stripeblk(fh, stripe, u, row % finfo[fh].unit), data[v], &src[v], &err)) == -1){
+            lcsched_cancel((char *)data, sizeof(data));
+            return -1;
+        }
+        queued += ret;
+        v++;
+    }
+    if(queued > 0){
+        lcsched_run(0);
+    }
+    if(err){
+        return -1;
+    }
+    lcparity_xor(buf, src, finfo[fh].width, LC_DEVICE_BLOCK_SIZE);
+    fsstats.degradedreads++;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flushparity
+//
+// Input        : fh, *dblk, n
+//
+// Description  : update the parity of the rows the placed delayed blocks
+//                (sorted by file block) fall in, once per row.
+//
+
+int flushparity(LcFHandle fh, delayblk *dblk, int n){
+    const char *known[LC_PARITY_MAXWIDTH];
+    uint32_t stripe, span = finfo[fh].unit * finfo[fh].width;
+    int i, j, k, o, touched;
+
+    for(i=0; i<n; i=j){
+        stripe = dblk[i].fblk / span;
+        for(j=i; j<n && dblk[j].fblk / span == stripe; j++);
+        for(o=0; o<finfo[fh].unit; o++){
+            memset(known, 0x0, sizeof(known));
+            for(k=i, touched=0; k<j; k++){
+                if(dblk[k].fblk % finfo[fh].unit == (uint32_t)o){
+                    known[(dblk[k].fblk / finfo[fh].unit) % finfo[fh].width] = dblk[k].data;
+                    touched = 1;
+                }
+            }
+            if(touched && parityrow(fh, stripe * finfo[fh].unit + o, known)){
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readblocks
+//
+// Input        : fh, *buf, filepos, len
+//
+// Description  : read len bytes of a file at filepos: holes and delayed
+//                blocks from memory, placed blocks from the cache or (all
+//                together) from the devices (rebuilt from the parity when
+//                their device has failed transfers).  On failure no device
+//                read into buf is left queued.
+//
+
+int readblocks(LcFHandle fh, char *buf, uint32_t filepos, uint32_t len){
+    char block[LC_DEVICE_BLOCK_SIZE], *start = buf;
+    uint32_t readbytes = len, fblk, lo = filepos / LC_DEVICE_BLOCK_SIZE, hi = (filepos + len - 1) / LC_DEVICE_BLOCK_SIZE;
+    uint16_t offset, remaining, size;
+    blkaddr *addr;
+    int queued = 0, ret, lastcluster = -1, err = 0;
+    int *errp = deferreads ? &deferfailed : &err;
+
+    while( readbytes > 0){
+
+        fblk = filepos / LC_DEVICE_BLOCK_SIZE;
+        offset = filepos % LC_DEVICE_BLOCK_SIZE; //e.g. 50%256 = 50,  500%256 = 244 (1block and 244bytes)
+        remaining = LC_DEVICE_BLOCK_SIZE - offset;  //e.g. 256-(500%256) = 12
+
+
+        //if exceeds the len we will read will be the remaining
+        if(readbytes < remaining){
+            size = readbytes;
+        }
+        else{
+            size = remaining;
+        }
+
+        addr = (fblk < finfo[fh].mapsize) ? &finfo[fh].blkmap[fblk] : NULL;
+
+        // packed tail: its bytes in the shared pack block
+        if(finfo[fh].packslot >= 0 && fblk == (uint32_t)finfo[fh].flength / LC_DEVICE_BLOCK_SIZE){
+            if((ret = queueblock(&packs[finfo[fh].packslot].addr, buf, finfo[fh].packoff+offset, size, errp)) == -1){
+                logMessage(LOG_ERROR_LEVEL, "Failed to read the packed tail of file %s", finfo[fh].fname);
+                lcsched_cancel(start, len);
+                return -1;
+            }
+            queued += ret;
+            fsstats.packreads++;
+        }
+        // hole (never written, or written as zeros), reads as zeros
+        else if(addr == NULL || addr->dev == BLK_UNALLOCATED){
+            memset(buf, 0x0, size);
+            fsstats.holereads++;
+        }
+        // block written but not yet placed on a device
+        else if(addr->dev == BLK_DELAYED){
+            memcpy(buf, finfo[fh].delayed[addr->sec].data+offset, size);
+            fsstats.delayedreads++;
+        }
+        // device with recent failures (devrecover) under a parity file, block
+        // not cached: rebuild it from the parity
+        else if(finfo[fh].unit > 0 && devinfo[addr->dev].errors > 0 &&
+                findcache(devinfo[addr->dev].did, addr->sec, addr->blk) == -1){
+            if(paritybuild(fh, fblk, block)){
+                logMessage(LOG_ERROR_LEVEL, "Failed to rebuild block %d of file %s", fblk, finfo[fh].fname);
+                lcsched_cancel(start, len);
+                return -1;
+            }
+            memcpy(buf, block+offset, size);
+        }
+        // copy from the cache, or queue the device read
+        else if((ret = queueblock(readcopy(fh, fblk), buf, offset, size, errp)) == -1){
+            logMessage(LOG_ERROR_LEVEL, "Failed to read block %d of file %s", fblk, finfo[fh].fname);
+            lcsched_cancel(start, len);
+            return -1;
+        }
+        else{
+            queued += ret;
+            //a block of a sequential read missed: the rest of its cluster comes in with it
+            if(ret == 1 && (lo == finfo[fh].nextread || lo + 1 == finfo[fh].nextread) && (int)(fblk / clusterblks) != lastcluster){
+                if(readcluster(fh, fblk, hi)){
+                    lcsched_cancel(start, len);
+                    return -1;
+                }
+                lastcluster = fblk / clusterblks;
+            }
+        }
+    
+        /////// update position, readbytes, and buf offset //////
+        filepos += size;
+        readbytes -= size;
+        buf += size;
+    }
+
+    // issue the queued device reads together (with the rest of the batch
+    // under lcsubmit); a failed write of someone else's stays queued, only
+    // this read's own device reads decide
+    finfo[fh].nextread = hi + 1;
+    if(queued > 0 && deferreads){
+        deferred += queued;
+    }
+    else if(queued > 0){
+        lcsched_run(0);
+    }
+    return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : delaykeep
+//
+// Input        : fh, from
+//
+// Description  : keep the file's delayed slots from.. only (when a flush
+//                stops part way): they move to the front, their map entries
+//                following them.
+//
+
+void delaykeep(LcFHandle fh, int from){
+    delayblk *dblk = finfo[fh].delayed;
+    int i;
+
+    for(i=from; i<finfo[fh].ndelayed; i++){
+        if(from > 0){
+            dblk[i-from] = dblk[i];
+        }
+        finfo[fh].blkmap[dblk[i-from].fblk].sec = i-from;
+    }
+    finfo[fh].ndelayed -= from;
+    delayedblocks -= from;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : delayflush
+//
+// Input        : fh
+//
+// Description  : place the file's delayed blocks on the devices: the blocks
+//                are sorted by file block, zero blocks become holes (with
+//                lczeroholes), duplicates of placed blocks share them, each run of consecutive file blocks left is allocated
+//                as one contiguous device run (where one is free), and the
+//                writes are queued (with the parity of the rows they are
+//                in, for parity files).  On failure the blocks not placed
+//                stay delayed (the parity covers those placed).
+//
+
+int delayflush(LcFHandle fh){
+    delayblk *dblk = finfo[fh].delayed, tmp;
+    blkaddr *addr;
+    LcDeviceId did;
+    uint32_t avoid;
+    int i, j, run, got, dev, sec, blk;
+
+    if(finfo[fh].ndelayed == 0){
+        return 0;
+    }
+
+    //sort by file block (the map entries follow their slots)
+    for(i=1; i<finfo[fh].ndelayed; i++){
+        for(j=i; j>0 && dblk[j].fblk < dblk[j-1].fblk; j--){
+            tmp = dblk[j];
+            dblk[j] = dblk[j-1];
+            dblk[j-1] = tmp;
+        }
+    }
+    delaykeep(fh, 0);
+
+    //all-zero blocks stay holes, blocks with the contents of an already
+    //placed block share it instead (not under parity: a stripe's blocks
+    //must stay on distinct devices, nor for mirrored files: a shared block
+    //has no replicas of its own)
+    for(i=0, j=0; i<finfo[fh].ndelayed && finfo[fh].unit == 0; i++){
+        if(zeroholes && iszero(dblk[i].data)){
+            punchblock(fh, dblk[i].fblk);
+            continue;
+        }
+        if(finfo[fh].copies == 1 && lcdedup_find(dblk[i].data, &dev, &sec, &blk) == 1){
+            addr = &finfo[fh].blkmap[dblk[i].fblk];
+            addr->dev = dev;
+            addr->sec = sec;
+            addr->blk = blk;
+            continue;
+        }
+        if(j != i){
+            dblk[j] = dblk[i];
+            finfo[fh].blkmap[dblk[j].fblk].sec = j;
+        }
+        j++;
+    }
+    if(finfo[fh].unit == 0){
+        delayedblocks -= finfo[fh].ndelayed - j;
+        finfo[fh].ndelayed = j;
+    }
+
+    for(i=0; i<finfo[fh].ndelayed; i+=got){
+        for(run=1; i+run<finfo[fh].ndelayed && dblk[i+run].fblk == dblk[i].fblk+run; run++);
+        //under parity a run stays within its stripe unit, on the emptiest
+        //device apart from those of the rest of the stripe
+        avoid = 0;
+        if(finfo[fh].unit > 0){
+            if(run > finfo[fh].unit - (int)(dblk[i].fblk % finfo[fh].unit)){
+                run = finfo[fh].unit - dblk[i].fblk % finfo[fh].unit;
+            }
+            avoid = stripemask(fh, dblk[i].fblk / (finfo[fh].unit * finfo[fh].width),
+                               (dblk[i].fblk / finfo[fh].unit) % finfo[fh].width);
+        }
+        if((got = allocdata(fh, dblk[i].fblk, run, avoid, &dev, &sec, &blk)) <= 0){
+            if(finfo[fh].unit > 0){
+                flushparity(fh, dblk, i);
+            }
+            delaykeep(fh, i);
+            return -1;
+        }
+        did = devinfo[dev].did;
+        for(j=0; j<got; j++){
+            addr = &finfo[fh].blkmap[dblk[i+j].fblk];
+            addr->dev = dev;
+            addr->sec = sec;
+            addr->blk = blk;
+            if(lcsched_write(did, sec, blk, dblk[i+j].data) || mirrorwrite(fh, dblk[i+j].fblk, dblk[i+j].data)){
+                //this block and the rest of the run stay delayed, their
+                //device blocks go back
+                addr->dev = BLK_DELAYED;
+                for(run=i+j; j<got; j++){
+                    lcloud_freeblk(dev, sec, blk);
+                    if(++blk == devinfo[dev].maxblk){
+                        blk = 0;
+                        sec++;
+                    }
+                }
+                if(finfo[fh].unit > 0){
+                    flushparity(fh, dblk, run);
+                }
+                delaykeep(fh, run);
+                return -1;
+            }
+            lcloud_putcache(did, sec, blk, dblk[i+j].data);
+            if(finfo[fh].unit == 0 && finfo[fh].copies == 1){
+                lcdedup_insert(dblk[i+j].data, dev, sec, blk);
+            }
+            if(++blk == devinfo[dev].maxblk){
+                blk = 0;
+                sec++;
+            }
+        }
+    }
+    run = finfo[fh].ndelayed;
+    finfo[fh].ndelayed = 0;
+    delayedblocks -= run;
+    if(finfo[fh].unit > 0 && flushparity(fh, dblk, run)){
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : delayreserve
+// Description  : hold a free device block for a new delayed block (or new
+//                tail block), so the write is refused now rather than at
+//                flush once every free block is held (given back as the
+//                block is placed or dropped)
+
+int delayreserve(void){
+    int n, nfree = 0;
+
+    for(n=0; n<devicenum; n++){
+        nfree += devinfo[n].nfree;
+    }
+    if(nfree <= delayedblocks){
+        logMessage(LOG_ERROR_LEVEL, "Failed to reserve block: all devices are full");
+        return -1;
+    }
+    delayedblocks++;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : delaywrite
+//
+// Input        : fh, fblk, *addr, offset, *buf, size
+//
+// Description  : write part of a block that has no device block yet into its
+//                delayed slot (taking a new, zeroed slot if needed, which
+//                fails once the devices have no free block left for it).
+//
+
+int delaywrite(LcFHandle fh, uint32_t fblk, blkaddr *addr, int offset, char *buf, int size){
+    int slot;
+
+    if(addr->dev == BLK_UNALLOCATED){
+        if(finfo[fh].delayed == NULL &&
+           (finfo[fh].delayed = (delayblk *)malloc(sizeof(delayblk) * delaymax)) == NULL){
+            logMessage(LOG_ERROR_LEVEL, "Failed to allocate delayed blocks of file %s", finfo[fh].fname);
+            return -1;
+        }
+        if((finfo[fh].ndelayed == delaymax && delayflush(fh)) || delayreserve()){
+            return -1;
+        }
+        slot = finfo[fh].ndelayed++;
+        finfo[fh].delayed[slot].fblk = fblk;
+        memset(finfo[fh].delayed[slot].data, 0x0, LC_DEVICE_BLOCK_SIZE);
+        addr->dev = BLK_DELAYED;
+        addr->sec = slot;
+    }
+    memcpy(finfo[fh].delayed[addr->sec].data+offset, buf, size);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tailflush
+//
+// Input        : fh
+//
+// Description  : write the file's buffered tail block out (allocating its
+//                device block if it is new) and empty the tail buffer.
+//
+
+int tailflush(LcFHandle fh){
+    blkaddr *addr;
+    LcDeviceId did;
+    bool held = finfo[fh].tailheld;
+
+    if(finfo[fh].tailblk < 0){
+        return 0;
+    }
+    if((addr = getfileblk(fh, finfo[fh].tailblk)) == NULL){
+        return -1;
+    }
+    //new blocks wait for delayed allocation (the free block the tail holds
+    //passes to the delayed slot)
+    if(addr->dev < 0){
+        delayedblocks -= held;
+        finfo[fh].tailheld = false;
+        if(delaywrite(fh, finfo[fh].tailblk, addr, 0, finfo[fh].tail, LC_DEVICE_BLOCK_SIZE)){
+            delayedblocks += held;
+            finfo[fh].tailheld = held;
+            return -1;
+        }
+    }
+    //written as zeros: back to a hole
+    else if(zeroholes && finfo[fh].unit == 0 && iszero(finfo[fh].tail)){
+        if(punchblock(fh, finfo[fh].tailblk)){
+            return -1;
+        }
+    }
+    //shared (deduplicated) block: the file gets its own copy
+    else if(lcdedup_release(addr->dev, addr->sec, addr->blk) > 0){
+        addr->dev = BLK_UNALLOCATED;
+        if(delaywrite(fh, finfo[fh].tailblk, addr, 0, finfo[fh].tail, LC_DEVICE_BLOCK_SIZE)){
+            return -1;
+        }
+    }
+    else{
+        did = devinfo[addr->dev].did;
+        if(lcsched_write(did, addr->sec, addr->blk, finfo[fh].tail) ||
+           mirrorwrite(fh, finfo[fh].tailblk, finfo[fh].tail) || paritywrite(fh, finfo[fh].tailblk, finfo[fh].tail)){
+            return -1;
+        }
+        lcloud_putcache(did, addr->sec, addr->blk, finfo[fh].tail);
+    }
+    finfo[fh].tailblk = -1;
+    if(fh < LC_STATS_MAXFILES){
+        fsstats.files[fh].tailflushes++;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tailload
+//
+// Input        : fh, fblk
+//
+// Description  : make a file block the buffered tail block, starting from its
+//                current contents (zeros if it has never been written).
+//
+
+int tailload(LcFHandle fh, uint32_t fblk){
+    blkaddr *addr;
+
+    if(tailflush(fh)){
+        return -1;
+    }
+    addr = (fblk < finfo[fh].mapsize) ? &finfo[fh].blkmap[fblk] : NULL;
+    if(addr == NULL || addr->dev == BLK_UNALLOCATED){
+        if(delayreserve()){
+            return -1;
+        }
+        finfo[fh].tailheld = true;
+        memset(finfo[fh].tail, 0x0, LC_DEVICE_BLOCK_SIZE);
+    }
+    else if(addr->dev == BLK_DELAYED){
+        memcpy(finfo[fh].tail, finfo[fh].delayed[addr->sec].data, LC_DEVICE_BLOCK_SIZE);
+    }
+    else if(getblock(readcopy(fh, fblk), finfo[fh].tail)){
+        return -1;
+    }
+    finfo[fh].tailblk = fblk;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tailwrite
+//
+// Input        : fh, fblk, offset, *buf, size
+//
+// Description  : write part of a file block into the tail buffer (making it
+//                the tail block first), writing it out once the block fills.
+//
+
+int tailwrite(LcFHandle fh, uint32_t fblk, int offset, char *buf, int size){
+    if(fblk != finfo[fh].tailblk && tailload(fh, fblk)){
+        logMessage(LOG_ERROR_LEVEL, "Failed to buffer block %d of file %s", fblk, finfo[fh].fname);
+        return -1;
+    }
+    memcpy(finfo[fh].tail+offset, buf, size);
+    if(fh < LC_STATS_MAXFILES){
+        fsstats.files[fh].tailwrites++;
+    }
+    if(offset+size == LC_DEVICE_BLOCK_SIZE){
+        return tailflush(fh);
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : blockwrite
+//
+// Input        : fh, fblk, offset, *buf, size
+//
+// Description  : write part of a file block through to its device block
+//                (allocating it, or merging with its current contents).
+//
+
+int blockwrite(LcFHandle fh, uint32_t fblk, int offset, char *buf, int size){
+    char tempbuf[LC_DEVICE_BLOCK_SIZE];
+    LcDeviceId did;
+    blkaddr *addr;
+
+    if((addr = getfileblk(fh, fblk)) == NULL){
+        return -1;
+    }
+
+    //new (or still unplaced) blocks wait for delayed allocation
+    if(addr->dev < 0){
+        return delaywrite(fh, fblk, addr, offset, buf, size);
+    }
+    //partial overwrite of a written block: read-modify-write
+    else if(size < LC_DEVICE_BLOCK_SIZE){
+        if(getblock(readcopy(fh, fblk), tempbuf)){
+            logMessage(LOG_ERROR_LEVEL, "Failed to read block %d of file %s", fblk, finfo[fh].fname);
+            return -1;
+        }
+        logMessage(LOG_INFO_LEVEL, "file overwrites from pos:%d", fblk*LC_DEVICE_BLOCK_SIZE+offset);
+    }
+
+    memcpy(tempbuf+offset, buf, size);
+
+    //written as zeros: back to a hole
+    if(zeroholes && finfo[fh].unit == 0 && iszero(tempbuf)){
+        return punchblock(fh, fblk);
+    }
+
+    //shared (deduplicated) block: the file gets its own copy
+    if(lcdedup_release(addr->dev, addr->sec, addr->blk) > 0){
+        addr->dev = BLK_UNALLOCATED;
+        return delaywrite(fh, fblk, addr, 0, tempbuf, LC_DEVICE_BLOCK_SIZE);
+    }
+    did = devinfo[addr->dev].did;
+    if(lcsched_write(did, addr->sec, addr->blk, tempbuf) || mirrorwrite(fh, fblk, tempbuf) ||
+       paritywrite(fh, fblk, tempbuf)){
+        return -1;
+    }
+    lcloud_putcache(did, addr->sec, addr->blk, tempbuf);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : freeblocks
+//
+// Input        : fh, from
+//
+// Description  : drop file blocks from..end: device blocks go back to the
+//                allocator (unless still shared) and out of the cache in one
+//                batch (replicas and parity with them), delayed and tail
+//                blocks are discarded.
+//
+
+int freeblocks(LcFHandle fh, uint32_t from){
+    LcCacheAddr *drop = NULL, stale;
+    blkaddr *addr;
+    uint32_t span;
+    int i, j, ndrop = 0;
+
+    if(finfo[fh].tailblk >= 0 && (uint32_t)finfo[fh].tailblk >= from){
+        finfo[fh].tailblk = -1;
+        if(finfo[fh].tailheld){
+            finfo[fh].tailheld = false;
+            delayedblocks--;
+        }
+    }
+    if((int)from < finfo[fh].mapsize &&
+       (drop = (LcCacheAddr *)malloc(sizeof(LcCacheAddr) * (finfo[fh].mapsize - from))) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failed to free blocks of file %s", finfo[fh].fname);
+        return -1;
+    }
+    for(i=from; i<finfo[fh].mapsize; i++){
+        mirrorfree(fh, i, 0);
+        addr = &finfo[fh].blkmap[i];
+        if(addr->dev >= 0 && lcdedup_release(addr->dev, addr->sec, addr->blk) == 0){
+            lcloud_freeblk(addr->dev, addr->sec, addr->blk);
+            drop[ndrop].did = devinfo[addr->dev].did;
+            drop[ndrop].sec = addr->sec;
+            drop[ndrop].blk = addr->blk;
+            ndrop++;
+        }
+        addr->dev = BLK_UNALLOCATED;
+    }
+    lcloud_cacheinvalidate(drop, ndrop);
+    free(drop);
+
+    //the cluster slots past the end are no longer held
+    for(i=from / clusterblks; i<finfo[fh].clmapsize; i++){
+        unreserve(fh, i, from);
+    }
+
+    //keep the delayed blocks before from (their map entries follow their slots)
+    for(i=0, j=0; i<finfo[fh].ndelayed; i++){
+        if(finfo[fh].delayed[i].fblk < from){
+            if(j != i){
+                finfo[fh].delayed[j] = finfo[fh].delayed[i];
+            }
+            finfo[fh].blkmap[finfo[fh].delayed[j].fblk].sec = j;
+            j++;
+        }
+    }
+    delayedblocks -= finfo[fh].ndelayed - j;
+    finfo[fh].ndelayed = j;
+
+    //parity: the rows of the stripes past the end go, the rows of the
+    //stripe cut in two are recomputed
+    if(finfo[fh].unit > 0){
+        span = finfo[fh].unit * finfo[fh].width;
+        for(i=(from + span - 1) / span * finfo[fh].unit; i<finfo[fh].mapsize; i++){
+            addr = &finfo[fh].parity[i];
+            if(addr->dev >= 0){
+                lcloud_freeblk(addr->dev, addr->sec, addr->blk);
+                stale.did = devinfo[addr->dev].did;
+                stale.sec = addr->sec;
+                stale.blk = addr->blk;
+                lcloud_cacheinvalidate(&stale, 1);
+                addr->dev = BLK_UNALLOCATED;
+            }
+        }
+        for(i=from / span * finfo[fh].unit; from % span != 0 && i<(int)(from / span + 1) * finfo[fh].unit; i++){
+            if(finfo[fh].parity[i].dev >= 0 && parityrow(fh, i, NULL)){
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : inlinepromote
+//
+// Input        : fh
+//
+// Description  : move an inline file into blocks: its contents become the
+//                buffered tail block 0 (placed like any other write).
+//
+
+int inlinepromote(LcFHandle fh){
+    char *data = finfo[fh].inldata;
+    int ret = 0;
+
+    finfo[fh].inldata = NULL;
+    if(finfo[fh].flength > 0){
+        ret = tailwrite(fh, 0, 0, data, finfo[fh].flength);
+    }
+    free(data);
+    fsstats.inlinepromotions++;
+    logMessage(LcDriverLLevel, "File %s (%d bytes) moved from inline into blocks", finfo[fh].fname, finfo[fh].flength);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : packfit
+// Description  : first granule of a free run of n granules in pack block p,
+//                -1 if the tail does not fit
+
+int packfit(int p, int n){
+    uint32_t run = (1u << n) - 1;
+    int g;
+
+    for(g=0; g+n <= LC_DEVICE_BLOCK_SIZE / LC_PACK_GRANULE; g++){
+        if((packs[p].used & (run << g)) == 0){
+            return g;
+        }
+    }
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : packalloc
+//
+// Input        : n, *g
+//
+// Description  : find room for a tail of n granules: the pack block last
+//                written (likely still cached), else the fullest pack block
+//                it fits in, else a new one.  Returns the pack block with g
+//                set to the first granule, -1 if failure.
+//
+
+int packalloc(int n, int *g){
+    packblk *grown;
+    int p, best = -1, bestfree = 0, nfree, dev, sec, blk;
+
+    if(lastpack >= 0 && packs[lastpack].addr.dev >= 0 && (*g = packfit(lastpack, n)) >= 0){
+        return lastpack;
+    }
+    for(p=0; p<npacks; p++){
+        if(packs[p].addr.dev < 0){
+            continue;
+        }
+        nfree = LC_DEVICE_BLOCK_SIZE / LC_PACK_GRANULE - __builtin_popcount(packs[p].used);
+        if(nfree >= n && (best < 0 || nfree < bestfree) && packfit(p, n) >= 0){
+            best = p;
+            bestfree = nfree;
+        }
+    }
+    if(best >= 0){
+        *g = packfit(best, n);
+        return lastpack = best;
+    }
+
+    //a new pack block, in an unused slot if there is one
+    for(p=0; p<npacks && packs[p].addr.dev >= 0; p++);
+    if(p == npacks){
+        if((grown = (packblk *)realloc(packs, sizeof(packblk) * (npacks + 16))) == NULL){
+            logMessage(LOG_ERROR_LEVEL, "Failed to allocate pack block table");
+            return -1;
+        }
+        packs = grown;
+        for(npacks += 16; p < npacks; p++){
+            packs[p].addr.dev = BLK_UNALLOCATED;
+            packs[p].used = 0;
+        }
+        p = npacks - 16;
+    }
+    if(allocrun(0, 0, 1, 0, &dev, &sec, &blk) != 1){
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate a pack block");
+        return -1;
+    }
+    packs[p].addr.dev = dev;
+    packs[p].addr.sec = sec;
+    packs[p].addr.blk = blk;
+    packs[p].used = 0;
+    fsstats.packblocks++;
+    *g = 0;
+    return lastpack = p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : packfree
+//
+// Input        : p, off, len
+//
+// Description  : give back the bytes off..off+len of pack block p, and the
+//                pack block itself once nothing is packed in it.
+//
+
+void packfree(int p, int off, int len){
+    LcCacheAddr drop;
+    uint32_t n = (len + LC_PACK_GRANULE - 1) / LC_PACK_GRANULE;
+
+    packs[p].used &= ~(((1u << n) - 1) << (off / LC_PACK_GRANULE));
+    fsstats.packbytes -= len;
+    if(packs[p].used == 0){
+        lcloud_freeblk(packs[p].addr.dev, packs[p].addr.sec, packs[p].addr.blk);
+        drop.did = devinfo[packs[p].addr.dev].did;
+        drop.sec = packs[p].addr.sec;
+        drop.blk = packs[p].addr.blk;
+        lcloud_cacheinvalidate(&drop, 1);
+        packs[p].addr.dev = BLK_UNALLOCATED;
+        fsstats.packblocks--;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : packtail
+//
+// Input        : fh
+//
+// Description  : move the partial last block of a file being closed into a
+//                pack block (read-modify-write of the shared block) and give
+//                its own block (tail buffer, delayed slot or device block)
+//                back once the pack block write is queued; until then the
+//                file keeps its own copy.  Files with replicas or parity
+//                keep their blocks.
+//
+
+int packtail(LcFHandle fh){
+    char data[LC_DEVICE_BLOCK_SIZE], block[LC_DEVICE_BLOCK_SIZE];
+    uint32_t fblk = finfo[fh].flength / LC_DEVICE_BLOCK_SIZE;
+    int len = finfo[fh].flength % LC_DEVICE_BLOCK_SIZE;
+    LcDeviceId did;
+    blkaddr *addr;
+    int p, g;
+
+    if(!tailpack || len == 0 || len > LC_PACK_MAXTAIL || finfo[fh].packslot >= 0 ||
+       finfo[fh].inldata != NULL || finfo[fh].copies > 1 || finfo[fh].unit > 0){
+        return 0;
+    }
+
+    //the tail's current contents (a hole is left alone)
+    addr = (fblk < (uint32_t)finfo[fh].mapsize) ? &finfo[fh].blkmap[fblk] : NULL;
+    if(fblk == (uint32_t)finfo[fh].tailblk){
+        memcpy(data, finfo[fh].tail, len);
+    }
+    else if(addr == NULL || addr->dev == BLK_UNALLOCATED){
+        return 0;
+    }
+    else if(addr->dev == BLK_DELAYED){
+        memcpy(data, finfo[fh].delayed[addr->sec].data, len);
+    }
+    else if(getblock(addr, data)){
+        return -1;
+    }
+
+    //write it into its pack block
+    if((p = packalloc((len + LC_PACK_GRANULE - 1) / LC_PACK_GRANULE, &g)) < 0){
+        return -1;
+    }
+    if(packs[p].used == 0){
+        memset(block, 0x0, LC_DEVICE_BLOCK_SIZE);
+    }
+    else if(getblock(&packs[p].addr, block)){
+        return -1;
+    }
+    memcpy(block + g * LC_PACK_GRANULE, data, len);
+    did = devinfo[packs[p].addr.dev].did;
+    if(lcsched_write(did, packs[p].addr.sec, packs[p].addr.blk, block)){
+        //a pack block allocated for this tail and never written goes back
+        if(packs[p].used == 0){
+            packfree(p, 0, 0);
+        }
+        return -1;
+    }
+    lcloud_putcache(did, packs[p].addr.sec, packs[p].addr.blk, block);
+    packs[p].used |= ((1u << ((len + LC_PACK_GRANULE - 1) / LC_PACK_GRANULE)) - 1) << g;
+    finfo[fh].packslot = p;
+    finfo[fh].packoff = g * LC_PACK_GRANULE;
+    fsstats.packbytes += len;
+    fsstats.packedtails++;
+
+    //the file's own block (tail buffer, delayed slot or device block) goes
+    if(freeblocks(fh, fblk)){
+        return -1;
+    }
+    logMessage(LcDriverLLevel, "Packed the %d byte tail of file %s at [%d/%d/%d]+%d", len, finfo[fh].fname,
+               devinfo[packs[p].addr.dev].did, packs[p].addr.sec, packs[p].addr.blk, finfo[fh].packoff);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unpacktail
+//
+// Input        : fh
+//
+// Description  : move a packed tail back into the file (as its buffered
+//                tail block) before it is written to or truncated.
+//
+
+int unpacktail(LcFHandle fh){
+    char block[LC_DEVICE_BLOCK_SIZE];
+    int p = finfo[fh].packslot, len = finfo[fh].flength % LC_DEVICE_BLOCK_SIZE;
+
+    if(p < 0){
+        return 0;
+    }
+    if(tailflush(fh) || getblock(&packs[p].addr, block) || delayreserve()){
+        logMessage(LOG_ERROR_LEVEL, "Failed to unpack the tail of file %s", finfo[fh].fname);
+        return -1;
+    }
+    memset(finfo[fh].tail, 0x0, LC_DEVICE_BLOCK_SIZE);
+    memcpy(finfo[fh].tail, block + finfo[fh].packoff, len);
+    finfo[fh].tailblk = finfo[fh].flength / LC_DEVICE_BLOCK_SIZE;
+    finfo[fh].tailheld = true;
+    packfree(p, finfo[fh].packoff, len);
+    finfo[fh].packslot = -1;
+    fsstats.unpackedtails++;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : batchreads
+//
+// Input        : *ops, *pend, *pendfh, *pendpos, npend, first
+//
+// Description  : issue the device reads queued by the pending reads of a
+//                batch (ops pend[], completions from ring slot first) in
+//                one scheduler run.  If that fails each read is done again
+//                on its own (replicated and parity files retry around the
+//                failing device) and its completion updated.
+//
+
+void batchreads(LcSubmission *ops, int *pend, LcFHandle *pendfh, uint32_t *pendpos, int npend, uint32_t first){
+    uint32_t pos;
+    int j;
+
+    if(npend == 0){
+        deferfailed = 0;
+        return;
+    }
+    fsstats.batchruns++;
+    deferreads = false;
+    lcsched_run(0);
+    if(deferfailed == 0){
+        fsstats.batchedreads += npend;
+    }
+    else{
+        logMessage(LOG_WARNING_LEVEL, "Batched device reads failed, reading the %d reads one at a time", npend);
+        for(j=0; j<npend; j++){
+            pos = finfo[pendfh[j]].pos;
+            finfo[pendfh[j]].pos = pendpos[j];
+            cring[(first + pend[j]) % LC_RING_ENTRIES].res = lcread(pendfh[j], ops[pend[j]].buf, ops[pend[j]].len);
+            finfo[pendfh[j]].pos = pos;
+        }
+    }
+    deferfailed = 0;
+    deferreads = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : contiguous
+// Description  : check if map entry b is the device block right after a
+
+bool contiguous(blkaddr *a, blkaddr *b){
+    return a->dev >= 0 && b->dev == a->dev &&
+        b->sec * devinfo[a->dev].maxblk + b->blk == a->sec * devinfo[a->dev].maxblk + a->blk + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : movable
+// Description  : check if defrag may move a map entry: a placed block no
+//                other file shares through dedup (moving it for one sharer
+//                would leave the others on the old copy, two copies again)
+
+bool movable(blkaddr *a){
+    return a->dev >= 0 && lcdedup_refs(a->dev, a->sec, a->blk) <= 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fragfile
+// Description  : add a file's placed blocks and extents to a report
+
+void fragfile(LcFHandle fh, LcFragReport *report){
+    blkaddr *map = finfo[fh].blkmap;
+    int i;
+
+    report->files++;
+    for(i=0; i<finfo[fh].mapsize; i++){
+        if(map[i].dev < 0){
+            continue;
+        }
+        report->blocks++;
+        if(i == 0 || !contiguous(&map[i-1], &map[i])){
+            report->extents++;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : relocate
+//
+// Input        : fh, fblk, n, dev, sec, blk
+//
+// Description  : move placed file blocks fblk..fblk+n-1 (at most
+//                LC_DEFRAG_BATCH) to the allocated run at dev/sec/blk: the
+//                blocks are read together, written to the run, and only
+//                then is the block map switched over and the old blocks
+//                freed (and dropped from the cache).
+//
+
+int relocate(LcFHandle fh, uint32_t fblk, int n, int dev, int sec, int blk){
+    char data[LC_DEFRAG_BATCH][LC_DEVICE_BLOCK_SIZE];
+    blkaddr moved[LC_DEFRAG_BATCH], *addr;
+    LcCacheAddr old[LC_DEFRAG_BATCH];
+    LcDeviceId did = devinfo[dev].did;
+    int i, ret, queued = 0, nold = 0, err = 0;
+
+    for(i=0; i<n; i++){
+        if((ret = queueblock(readcopy(fh, fblk+i), data[i], 0, LC_DEVICE_BLOCK_SIZE, &err)) == -1){
+            lcsched_cancel((char *)data, sizeof(data));
+            return -1;
+        }
+        queued += ret;
+    }
+    if(queued > 0){
+        lcsched_run(0);
+    }
+    if(err){
+        return -1;
+    }
+
+    for(i=0; i<n; i++){
+        if(lcsched_write(did, sec, blk, data[i])){
+            return -1;
+        }
+        lcloud_putcache(did, sec, blk, data[i]);
+        moved[i].dev = dev;
+        moved[i].sec = sec;
+        moved[i].blk = blk;
+        if(++blk == devinfo[dev].maxblk){
+            blk = 0;
+            sec++;
+        }
+    }
+
+    for(i=0; i<n; i++){
+        addr = &finfo[fh].blkmap[fblk+i];
+        if(lcdedup_release(addr->dev, addr->sec, addr->blk) == 0){
+            lcloud_freeblk(addr->dev, addr->sec, addr->blk);
+            old[nold].did = devinfo[addr->dev].did;
+            old[nold].sec = addr->sec;
+            old[nold].blk = addr->blk;
+            nold++;
+        }
+        *addr = moved[i];
+        if(finfo[fh].copies == 1){
+            lcdedup_insert(data[i], dev, moved[i].sec, moved[i].blk);
+        }
+    }
+    lcloud_cacheinvalidate(old, nold);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : defragfile
+//
+// Input        : fh, *moved
+//
+// Description  : rewrite each stretch of placed (unshared, see movable)
+//                blocks of a file that spans more than one extent into the
+//                longest free run (when that is longer than the extent it
+//                starts with).
+//
+
+int defragfile(LcFHandle fh, uint64_t *moved){
+    blkaddr *map;
+    LcCacheAddr stale;
+    uint32_t avoid;
+    int i, j, n, seg, ext, got, dev, sec, blk;
+
+    if(tailflush(fh) || delayflush(fh)){
+        return -1;
+    }
+    //moving blocks would break the device layout of the parity stripes
+    if(finfo[fh].unit > 0){
+        return 0;
+    }
+    map = finfo[fh].blkmap;
+    for(i=0; i<finfo[fh].mapsize; ){
+        if(!movable(&map[i])){
+            i++;
+            continue;
+        }
+        for(seg=1; i+seg < finfo[fh].mapsize && movable(&map[i+seg]); seg++);
+        for(ext=1; ext < seg && contiguous(&map[i+ext-1], &map[i+ext]); ext++);
+        if(ext == seg){
+            i += seg;
+            continue;
+        }
+
+        //the longest free run, on a device without replicas of the stretch
+        for(j=0, avoid=0; j<seg; j++){
+            avoid |= mirrormask(fh, i+j);
+        }
+        if((got = allocrun(fh, i, seg, avoid, &dev, &sec, &blk)) <= ext){
+            //nothing better free: give the run back, keep the extent
+            for(j=0; j<got; j++){
+                lcloud_freeblk(dev, sec + (blk + j) / devinfo[dev].maxblk, (blk + j) % devinfo[dev].maxblk);
+            }
+            i += ext;
+            continue;
+        }
+        for(j=0; j<got; j+=n){
+            n = (got - j < LC_DEFRAG_BATCH) ? got - j : LC_DEFRAG_BATCH;
+            if(relocate(fh, i+j, n, dev, sec + (blk + j) / devinfo[dev].maxblk, (blk + j) % devinfo[dev].maxblk)){
+                logMessage(LOG_ERROR_LEVEL, "Failed to relocate blocks of file %s", finfo[fh].fname);
+                //the rest of the run (the failed batch's blocks written or
+                //not) goes back, the blocks stay where they were
+                *moved += j;
+                for(; j<got; j++){
+                    stale.did = devinfo[dev].did;
+                    stale.sec = sec + (blk + j) / devinfo[dev].maxblk;
+                    stale.blk = (blk + j) % devinfo[dev].maxblk;
+                    lcloud_freeblk(dev, stale.sec, stale.blk);
+                    lcloud_cacheinvalidate(&stale, 1);
+                }
+                return -1;
+            }
+        }
+        *moved += got;
+        i += got;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcpoweron
+//
+// Description  : power on the device 
+//                  
+//                b0/b1 - which direction / return status
+//                c0    - Operation code (poweron/off/probe/transfer)
+//                c1    - device id
+//                c2    - read(0)/write(1)
+//                d0/d1 - sector/block
+//
+
+int32_t lcpoweron(void){
+    int i;
+    int fd;
+    int reserved0;
+
+    // cache and I/O scheduler init
+    lcloud_initcache(LC_CACHE_MAXBLOCKS);
+    lcsched_init(sched_xfer);
+
+    // reset performance counters and latency histograms
+    memset(&fsstats, 0x0, sizeof(fsstats));
+    lchist_reset();
+    allocatedblock = 0;
+    totalblock = 0;
+    delayedblocks = 0;
+    now = 0;
+
+    logMessage(LcControllerLLevel, "Initialzing Lion Cloud system ...");
+
+    // Do Operation - PowerOn
+    frm = create_lcloud_registers(0, 0 ,LC_POWER_ON ,0, 0, 0, 0); 
+    rfrm = io_bus(frm, NULL);
+    extract_lcloud_registers(rfrm, &b0, &b1, &c0, &c1, &c2, &d0, &d1);
+
+    isDeviceOn = true;
+    bool first = true; //check if is calling probeID first time
+
+    int n=0; //devinit loop counter
+    
+    //zeroed: no device has its block metadata yet (devmeta)
+    devinfo = (device *)calloc(devicenum, sizeof(device));
+
+    // Do Operation - Devprobe
+    frm = create_lcloud_registers(0, 0 ,LC_DEVPROBE ,0, 0, 0, 0); 
+    rfrm = io_bus(frm, NULL);
     extract_lcloud_registers(rfrm, &b0, &b1, &c0, &c1, &c2, &d0, &d1); //after extract I get probed d0 (22048)
 
     //---------------------- Device init ----------------------------//
@@ -339,41 +2481,36 @@ int32_t lcpoweron(void){
         //logMessage(LcControllerLLevel, "Found device [%d] in cloud probe.", devinfo->did);
 
         frm = create_lcloud_registers(0, 0 ,LC_DEVINIT ,devinfo[n].did, 0, 0, 0); 
-        rfrm = lcloud_io_bus(frm, NULL);
+        rfrm = io_bus(frm, NULL);
         reserved0 = d0; // reserve d0 after probeID function
         extract_lcloud_registers(rfrm, &b0, &b1, &c0, &c1, &c2, &d0, &d1);
         devinfo[n].maxsec = d0;
         devinfo[n].maxblk = d1;
+        devinfo[n].nfree = d0 * d1;
+        devinfo[n].credit = 0;
         logMessage(LcControllerLLevel, "Found device [did=%d, secs=%d, blks=%d] in cloud probe.", devinfo[n].did, d0, d1);
 
         
 
-        //------------2d array dynamic allocation----------//
-        devinfo[n].storage = (char **) malloc(sizeof(char*) * devinfo[n].maxsec); //ex. did = 5,  blk = 64
-        devinfo[n].fileblktracker = (char **) malloc(sizeof(char*) * devinfo[n].maxsec); //ex. did = 5,  blk = 64
-        devinfo[n].filepostracker = (uint16_t **) malloc(sizeof(uint16_t*) * devinfo[n].maxsec); //ex. did = 5,  blk = 64
-        for(i=0; i<devinfo[n].maxsec; i++){
-            devinfo[n].storage[i] = (char *) malloc(sizeof(char) * devinfo[n].maxblk);  //ex. did = 5. sec = 10
-            devinfo[n].fileblktracker[i] = (char *) malloc(sizeof(char) * devinfo[n].maxblk);  //ex. did = 5. sec = 10
-            devinfo[n].filepostracker[i] = (uint16_t *) malloc(sizeof(uint16_t) * devinfo[n].maxblk);  //ex. did = 5. sec = 10
-        }
-        // zero out storage (device tracker)
-        for(i=0; i<devinfo[n].maxsec; i++){
-            for(j=0; j< devinfo[n].maxblk; j++){
-                devinfo[n].storage[i][j] = 0;
-                devinfo[n].fileblktracker[i][j] = 0;
-                devinfo[n].filepostracker[i][j] = 0;
-            }
-        }
-        /////////////////////////////////////////////////////
+        //the block metadata is set up when the allocator first uses the device (devmeta)
 
         totalblock += devinfo[n].maxsec * devinfo[n].maxblk;
+
+        fsstats.devices[n].did = devinfo[n].did;
+        fsstats.devices[n].maxsec = devinfo[n].maxsec;
+        fsstats.devices[n].maxblk = devinfo[n].maxblk;
+        fsstats.devices[n].free = devinfo[n].nfree;
+        fsstats.numdevices = n+1;
+        fsstats.totalblocks = totalblock;
     
         
         //increment index(next device)
         n++;
     }while(n<devicenum);
 
+    // content index for deduplication
+    lcdedup_init(totalblock);
+
     ////////////////// file initialize //////////////////////
     for(fd=0; fd<filenum; fd++){
 
@@ -383,15 +2520,33 @@ int32_t lcpoweron(void){
         finfo[fd].fhandle = -1;
         finfo[fd].flength = -1;
         //device <-> file
-        finfo[fd].fdid = -1;
-        finfo[fd].fsec = -1;
-        finfo[fd].fblk = -1;
-        finfo[fd].wfnow = -1;
-        finfo[fd].rfnow = -1;
+        finfo[fd].blkmap = NULL;
+        finfo[fd].mapsize = 0;
+        finfo[fd].tailblk = -1;
+        finfo[fd].tailheld = false;
+        finfo[fd].delayed = NULL;
+        finfo[fd].ndelayed = 0;
+        finfo[fd].copies = 1;
+        for(i=0; i<LC_MAX_COPIES-1; i++){
+            finfo[fd].mirror[i] = NULL;
+        }
+        finfo[fd].width = 0;
+        finfo[fd].unit = 0;
+        finfo[fd].parity = NULL;
+        finfo[fd].clmap = NULL;
+        finfo[fd].clmapsize = 0;
+        finfo[fd].nextread = 0;
+        finfo[fd].inldata = NULL;
+        finfo[fd].packslot = -1;
     }
+    packs = NULL;
+    npacks = 0;
+    lastpack = -1;
 
-
-    //lcloud_initcache();
+    // warm restart: read back the hot blocks of the cache snapshot that a
+    // file holds (the file metadata is reset above, so until it persists
+    // across power cycles every key is skipped)
+    lcloud_cacheprefetch(prefetchblk, lcsched_run);
 
     return 0;
 }
@@ -408,42 +2563,80 @@ int32_t lcpoweron(void){
 
 LcFHandle lcopen( const char *path ) {
 
-    int fd=0;
+    int fd, i;
+    uint64_t tstart = lchist_now();
 
     //check if power is off, and poweron
     if(isDeviceOn == false){
         lcpoweron();
     }
 
-    while(fd < filenum){
-        //check if opening the file again
+    //check if opening the file again (handle 0 is never used)
+    for(fd=1; fd<filenum; fd++){
         if(strcmp(path, finfo[fd].fname) == 0){
-            if(finfo[fd].isopen == true){
-                logMessage(LOG_ERROR_LEVEL, "File is already opened.\n\n");
-                return -1;
-            }
+            break;
+        }
+    }
+
+    if(fd < filenum){
+        if(finfo[fd].isopen == true){
+            logMessage(LOG_ERROR_LEVEL, "File is already opened.\n\n");
+            return -1;
+        }
+        //reopen keeps the file contents
+        finfo[fd].isopen = true;
+        finfo[fd].pos = 0;
+    }
+    else{
+        //if we are opening another file, pick the next unused file handle
+        for(fd=1; fd<filenum && finfo[fd].fname[0] != '\0'; fd++);
+        if(fd == filenum){
+            logMessage(LOG_ERROR_LEVEL, "Failed to open [%s]: too many files", path);
+            return -1;
         }
-        //if we are opening another file, increment the file handle
-        else{ 
-            fd++;
-            if(finfo[fd].isopen == false ) break;
+
+        finfo[fd].isopen = true;
+        finfo[fd].fname = strdup(path);        //save file name
+        finfo[fd].fhandle = fd;                //pick unique file handle
+        finfo[fd].pos = 0;                     //set file pointer to first byte
+        finfo[fd].flength = 0;
+        //device <-> file
+        finfo[fd].blkmap = NULL;
+        finfo[fd].mapsize = 0;
+        finfo[fd].tailblk = -1;
+        finfo[fd].tailheld = false;
+        finfo[fd].delayed = NULL;
+        finfo[fd].ndelayed = 0;
+        finfo[fd].copies = 1;
+        for(i=0; i<LC_MAX_COPIES-1; i++){
+            finfo[fd].mirror[i] = NULL;
         }
+        finfo[fd].width = 0;
+        finfo[fd].unit = 0;
+        finfo[fd].parity = NULL;
+        finfo[fd].clmap = NULL;
+        finfo[fd].clmapsize = 0;
+        finfo[fd].nextread = 0;
+        //small new files start inline
+        finfo[fd].inldata = NULL;
+        if(inlinemax > 0 && (finfo[fd].inldata = (char *)calloc(1, LC_INLINE_MAXBYTES)) != NULL){
+            fsstats.inlinefiles++;
+        }
+        finfo[fd].packslot = -1;
     }
 
-    finfo[fd].isopen = true;
-    finfo[fd].fname = strdup(path);        //save file name
-    finfo[fd].fhandle = fd;                //pick unique file handle
-    finfo[fd].pos = 0;                     //set file pointer to first byte
-    finfo[fd].flength = 0;
-    //device <-> file
-    finfo[fd].fdid = 0;
-    finfo[fd].fsec = 0;
-    finfo[fd].fblk = 0;
-    finfo[fd].wfnow = 0;
-    finfo[fd].rfnow = 0;
+    if(fd < LC_STATS_MAXFILES){
+        fsstats.files[fd].fh = fd;
+        strncpy(fsstats.files[fd].name, path, LC_STATS_MAXNAME-1);
+        fsstats.files[fd].opens++;
+        if(fd >= fsstats.numfiles){
+            fsstats.numfiles = fd+1;
+        }
+    }
 
     logMessage(LcControllerLLevel, "Opened new file [%s], fh=%d.", finfo[fd].fname, finfo[fd].fhandle);
 
+    lchist_record(LC_HIST_OPEN, tstart);
     return(finfo[fd].fhandle);
 } 
 
@@ -459,99 +2652,59 @@ LcFHandle lcopen( const char *path ) {
 
 int lcread( LcFHandle fh, char *buf, size_t len ) {
 
-    uint32_t readbytes, filepos;
-    //uint64_t blknum, secnum;
-    uint16_t offset, remaining, size;
-    char tempbuf[LC_DEVICE_BLOCK_SIZE];
-    prevfilesnow = readnow; // save last block point
+    uint32_t filepos;
+    int ret;
+    uint64_t tstart = lchist_now();
+
 
-    memset(tempbuf, 0x0, LC_DEVICE_BLOCK_SIZE);
-    
     /*************Error Checking****************/
 
     //check if file handle is valid (is associated with open file)
-    if(fh < 0 || finfo[fh].isopen == false){
+    if(fh < 0 || fh >= filenum || finfo[fh].isopen == false){
         logMessage(LOG_ERROR_LEVEL, "Failed to read: file handle is not valid or file is not opened");
         return -1;
     }
-    //check length to if it is valid
-    if(len < 0){
-        logMessage(LOG_ERROR_LEVEL, "Failed to read: length is not valid");
-        return -1;
-    }
     //check if reading exceeds end of the file
     if(finfo[fh].pos+len > finfo[fh].flength){
         logMessage(LOG_ERROR_LEVEL, "Reading exceeds end of the file");
         return -1;
     }
 
-    int start = finfo[fh].flength - finfo[fh].pos;
-    if(len > start){
-        len = start;
-    }
-
     filepos = finfo[fh].pos;
-    readbytes = len;
-
-
-    /////////////// begin reading ////////////////////
-
-    while( readbytes > 0){
-
-        findsamefileblock(readnow, fh);  
-
-        offset = filepos % LC_DEVICE_BLOCK_SIZE; //e.g. 50%256 = 50,  500%256 = 244 (1block and 244bytes)
-        remaining = LC_DEVICE_BLOCK_SIZE - offset;  //e.g. 256-(500%256) = 12
-
-
-        //if exceeds the len we will write will be the remaining
-        if(readbytes < remaining){
-            size = readbytes;
-        }
-        else{
-            size = remaining;
-        }
-
-        // if found in cache, get it
-        if(findcache(devinfo[readnow].did, devinfo[readnow].rsec, devinfo[readnow].rblk) != 0){
-            memcpy(tempbuf, lcloud_getcache(devinfo[readnow].did, devinfo[readnow].rsec, devinfo[readnow].rblk), 256);
-            memcpy(buf, tempbuf+offset, size);
-        }
 
-        /************ if read exceeds the block size (256) *************/
-        else if(offset + readbytes >= LC_DEVICE_BLOCK_SIZE){
-            // read, and copy up to len to the buf
-            do_read(devinfo[readnow].did, devinfo[readnow].rsec, devinfo[readnow].rblk, tempbuf);
-            memcpy(buf, tempbuf+offset, size); 
-        }
-        else{
-
-            // read, and copy up to len to the buf
-            do_read(devinfo[readnow].did, devinfo[readnow].rsec, devinfo[readnow].rblk, tempbuf);
-            memcpy(buf, tempbuf+offset, size);
-        }
-    
-        /////// update position, readbytes, and buf offset //////
-        filepos += size;
-        readbytes -= size;
-        buf += size;
-        devinfo->devread += size;
-        finfo[fh].rfnow = readnow;      
-
-
-        //nextdevice(&readnow);
-    
-        
-        // if position exceeds the size of the file then increase file size to current position
-        if(filepos > finfo[fh].flength){
-            finfo[fh].flength = filepos;
-        }
+    //write out the buffered tail block if the read covers it
+    if(len > 0 && finfo[fh].tailblk >= filepos / LC_DEVICE_BLOCK_SIZE &&
+       finfo[fh].tailblk <= (filepos + len - 1) / LC_DEVICE_BLOCK_SIZE && tailflush(fh)){
+        return -1;
+    }
 
-        finfo[fh].pos = filepos;
+    //inline file: straight from the file record
+    if(finfo[fh].inldata != NULL){
+        memcpy(buf, finfo[fh].inldata+filepos, len);
+        fsstats.inlinereads++;
+        ret = 0;
+    }
+    //a replicated (or parity) file whose read failed on a device is read
+    //again: the failing device has an error now, so the other copies are
+    //picked (the blocks are rebuilt from the parity)
+    else if((ret = readblocks(fh, buf, filepos, len)) && (finfo[fh].copies > 1 || finfo[fh].unit > 0)){
+            logMessage(LOG_WARNING_LEVEL, "Retrying read of file %s around the failed device", finfo[fh].fname);
+        fsstats.failovers++;
+        ret = readblocks(fh, buf, filepos, len);
+    }
+    if(ret){
+        logMessage(LOG_ERROR_LEVEL, "Failed to read file %s", finfo[fh].fname);
+        return -1;
+    }
+    finfo[fh].pos = filepos + len;
 
+    if(fh < LC_STATS_MAXFILES){
+        fsstats.files[fh].reads++;
+        fsstats.files[fh].bytesread += len;
     }
 
     logMessage(LcDriverLLevel, "Driver read %d bytes to file %s", len, finfo[fh].fname, finfo[fh].flength);
+    lchist_record(LC_HIST_READ, tstart);
     return( len );
 }
 
@@ -567,79 +2720,53 @@ int lcread( LcFHandle fh, char *buf, size_t len ) {
 
 int lcwrite( LcFHandle fh, char *buf, size_t len ) {
 
-    uint64_t writebytes, filepos;
+    uint64_t writebytes, filepos, fblk;
     uint16_t offset, remaining, size;
-    char tempbuf[LC_DEVICE_BLOCK_SIZE];
-    prevfilesnow = now; // save last block point
+    uint64_t tstart = lchist_now();
     
     
 
     /*************Error Checking****************/
 
     //check if file handle is valid (is associated with open file)
-    if(finfo[fh].fhandle != fh || fh < 0 || finfo[fh].isopen == false){
+    if(fh < 0 || fh >= filenum || finfo[fh].fhandle != fh || finfo[fh].isopen == false){
         logMessage(LOG_ERROR_LEVEL, "Failed to write: file handle is not valid or file is not opened");
         return -1;
     }
-    //check length to if it is valid
-    if(len < 0){
-        logMessage(LOG_ERROR_LEVEL, "Failed to write: length is not valid");
-        return -1;
-    }
     
     /******************Begin Writing********************/
-    writebytes = len;;
+    writebytes = len;
     filepos = finfo[fh].pos;
 
-
-    while(writebytes > 0){
-        
-        getfreeblk(now, fh);   // find empty block within the passed device
-
-        if(devinfo[now].storage[devinfo[now].sec][devinfo[now].blk] == 0){  //if writing first time on that blk
-            devinfo[now].filepostracker[devinfo[now].sec][devinfo[now].blk] = filepos; //each blk remembers filepos (beginning)
+    //inline file: the write stays in the file record while the file fits,
+    //otherwise the file moves into blocks first
+    if(finfo[fh].inldata != NULL){
+        if(filepos + len <= (uint64_t)inlinemax){
+            memcpy(finfo[fh].inldata+filepos, buf, len);
+            writebytes = 0;
+            finfo[fh].pos = filepos + len;
+            if(finfo[fh].pos > finfo[fh].flength){
+                finfo[fh].flength = finfo[fh].pos;
+            }
+            fsstats.inlinewrites++;
         }
-
-        // if there's block has some space left, go back to device that file lastly wrote
-        if(devinfo[finfo[fh].wfnow].storage[finfo[fh].fsec][finfo[fh].fblk] == 1){
-            now = finfo[fh].wfnow;
-            findnextfreedev = true;
+        else if(inlinepromote(fh)){
+            return -1;
         }
+    }
+    //a write reaching the packed tail takes it back first
+    if(writebytes > 0 && finfo[fh].packslot >= 0 &&
+       filepos + len > (uint64_t)finfo[fh].flength / LC_DEVICE_BLOCK_SIZE * LC_DEVICE_BLOCK_SIZE && unpacktail(fh)){
+        return -1;
+    }
 
-        // just in case of F-15 off=925 sz=298  -> when there's block file did not finish writing but skip and tries to find empty blk in same device
-        if(prevfilesnow == finfo[fh].wfnow && devinfo[finfo[fh].wfnow].storage[finfo[fh].fsec][finfo[fh].fblk] == 1){
-            devinfo[now].sec = finfo[fh].fsec;
-            devinfo[now].blk = finfo[fh].fblk;
-        }
 
-        // when seek brings back to position where already written
-        if(filepos < finfo[fh].flength){
-            wfindsamefileblock(now, fh);
-            logMessage(LOG_INFO_LEVEL, "file overwrites from pos:%d", filepos);
-        }
-      
-        
-        //allocate block if block is empty
-        else if(devinfo[now].storage[devinfo[now].sec][devinfo[now].blk] < 1){
-            devinfo[now].storage[devinfo[now].sec][devinfo[now].blk] = 1;
-            allocatedblock++;
-            logMessage(LOG_INFO_LEVEL, "Allocated block %d out of %d (%0.2f%%)", allocatedblock, totalblock, (float)allocatedblock/(float)totalblock);
-            logMessage(LcDriverLLevel, "Allocated block for data [%d/%d/%d]", devinfo[now].did, devinfo[now].sec, devinfo[now].blk);
-            finfo[fh].fdid = devinfo[now].did;
-            finfo[fh].fsec = devinfo[now].sec;
-            finfo[fh].fblk = devinfo[now].blk;
-        } 
-        
+    while(writebytes > 0){
+
+        fblk = filepos / LC_DEVICE_BLOCK_SIZE;
         offset = filepos % LC_DEVICE_BLOCK_SIZE;  //e.g. 50%256 = 50,  500%256 = 244 (1block and 244bytes)
         remaining = LC_DEVICE_BLOCK_SIZE - offset;  //e.g. 256-(500%256) = 12
 
-
-        if(devinfo[now].blk > devinfo[now].maxblk){
-            logMessage(LOG_ERROR_LEVEL, "Block number exceeds memory");
-            return -1;
-        }
-        
-
         //if exceeds the len we will write will be the remaining
         if(writebytes < remaining){
             size = writebytes;
@@ -648,92 +2775,21 @@ int lcwrite( LcFHandle fh, char *buf, size_t len ) {
             size = remaining;
         }
 
-        /************** if fills exactly 256  *****************/
-        if(offset + writebytes == LC_DEVICE_BLOCK_SIZE){
-            if(filepos < finfo[fh].flength){
-                do_read(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf); //read to find offset
-                memcpy(tempbuf+offset, buf, writebytes );
-                do_write(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf);
-                lcloud_putcache(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf);
-            }
-            else{
-                do_read(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf); //read to find offset
-                memcpy(tempbuf+offset, buf, writebytes );
-                do_write(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf);
-                lcloud_putcache(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf);
-            }
-            
-
-            if(devinfo[now].sec != finfo[fh].fsec || devinfo[now].blk != finfo[fh].fblk){
-                devinfo[now].storage[finfo[fh].fsec][finfo[fh].fblk] = 2;
-            }
-            else{
-                devinfo[now].storage[devinfo[now].sec][devinfo[now].blk] = 2; // block is full
-            }
-        }
-        /////////// one block done ///////////
-
-
-        /************* if exceeds the block size **************/
-        else if(offset + writebytes > LC_DEVICE_BLOCK_SIZE){ 
-            if(filepos < finfo[fh].flength){
-                do_read(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf); //read to find offset
-                memcpy(tempbuf+offset, buf, size );
-                do_write(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf);
-                lcloud_putcache(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf);
-            }
-            else{
-                do_read(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf);
-                memcpy(tempbuf+offset, buf, size );
-                do_write(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf);
-                lcloud_putcache(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf);
-            }
-
-            if(devinfo[now].sec != finfo[fh].fsec || devinfo[now].blk != finfo[fh].fblk){
-                devinfo[now].storage[finfo[fh].fsec][finfo[fh].fblk] = 2;
-            }
-            else{
-                devinfo[now].storage[devinfo[now].sec][devinfo[now].blk] = 2; // block is full
-            }
-        }
-
-        else{  //if(offset + len < 256)
-            if(filepos < finfo[fh].flength){
-                do_read(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf); //read to find offset
-                memcpy(tempbuf+offset, buf, size );
-                do_write(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf);
-                lcloud_putcache(devinfo[now].did, devinfo[now].sec, devinfo[now].blk, tempbuf);
-            }
-            else{
-                do_read(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf);
-                memcpy(tempbuf+offset, buf, size ); //flength%256 instead of size?
-                do_write(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf);
-                lcloud_putcache(finfo[fh].fdid, finfo[fh].fsec, finfo[fh].fblk, tempbuf);
+        //small appends (and anything landing in the buffered tail block) collect
+        //in the tail buffer, which is written out when the block fills
+        if(fblk == finfo[fh].tailblk || (size < LC_DEVICE_BLOCK_SIZE && filepos == finfo[fh].flength)){
+            if(tailwrite(fh, fblk, offset, buf, size)){
+                return -1;
             }
         }
-        
-
-
-        if(filepos < finfo[fh].flength){
-            devinfo[now].storage[devinfo[now].sec][devinfo[now].blk] = 3; // when overwritten
+        else if(blockwrite(fh, fblk, offset, buf, size)){
+            return -1;
         }
-        
-
-        // block remembers which file wrote on it
-        devinfo[now].fileblktracker[finfo[fh].fsec][finfo[fh].fblk] = finfo[fh].fhandle;
 
         ////////update pos, decrease len used (bytesleft to write), update buffer after written///////////////////
         filepos += size; 
         writebytes -= size;
         buf += size;
-        devinfo[now].devwritten += size; // plus amount of overwritten
-        finfo[fh].wfnow = now;
-
-
-        // if device is full, go to next device
-        if(devinfo[now].storage[devinfo[now].maxsec-1][devinfo[now].maxblk-1] == 2){
-            nextdevice(&now);
-        }
     
 
         // if position exceeds the size of the file then increase file size to current position
@@ -742,11 +2798,15 @@ int lcwrite( LcFHandle fh, char *buf, size_t len ) {
         }
       
         finfo[fh].pos = filepos;
-
-        findnextfreedev = false; //reset toggle
     }
     
+    if(fh < LC_STATS_MAXFILES){
+        fsstats.files[fh].writes++;
+        fsstats.files[fh].byteswritten += len;
+    }
+
     logMessage(LcDriverLLevel, "Driver wrote %d bytes to file %s (now %d bytes)", len, finfo[fh].fname, finfo[fh].flength);
+    lchist_record(LC_HIST_WRITE, tstart);
     return( len );
 }
 
@@ -761,18 +2821,31 @@ int lcwrite( LcFHandle fh, char *buf, size_t len ) {
 
 int lcseek( LcFHandle fh, size_t off ) {
     //filesys finfo;
+    uint64_t tstart = lchist_now();
 
-    if(fh < 0 || finfo[fh].isopen == false || isDeviceOn == false || finfo[fh].flength < 0 /*||(finfo[fh].pos + off) > finfo[fh].flength*/){
+    if(fh < 0 || fh >= filenum || finfo[fh].isopen == false || isDeviceOn == false || finfo[fh].flength < 0 /*||(finfo[fh].pos + off) > finfo[fh].flength*/){
         logMessage(LOG_ERROR_LEVEL, "file failed to seek in");
         return -1;
     }
+    //seeking past the end is fine: writing there leaves a hole (no device
+    //blocks) that reads as zeros
     if(finfo[fh].flength < off){
-        logMessage(LOG_ERROR_LEVEL, "Seeking out of file [%d < %d]", finfo[fh].flength, off);
+        logMessage(LcDriverLLevel, "Seeking past end of file %s [%d < %d]", finfo[fh].fname, finfo[fh].flength, off);
+    }
+
+    if(fh < LC_STATS_MAXFILES){
+        fsstats.files[fh].seeks++;
+    }
+
+    //seeking away from the buffered tail block writes it out
+    if(finfo[fh].tailblk >= 0 && off / LC_DEVICE_BLOCK_SIZE != finfo[fh].tailblk && tailflush(fh)){
+        return -1;
     }
 
     logMessage(LcDriverLLevel, "Seeking to position %d in file handle %d [%s]", off, fh, finfo[fh].fname);
     finfo[fh].pos = off;
 
+    lchist_record(LC_HIST_SEEK, tstart);
     return( finfo[fh].pos ); //fix this 
 }
 
@@ -785,20 +2858,250 @@ int lcseek( LcFHandle fh, size_t off ) {
 // Outputs      : 0 if successful test, -1 if failure
 
 int lcclose( LcFHandle fh ) {
+    uint64_t tstart = lchist_now();
 
     //check if there is no file to close
-    if(finfo[fh].isopen == false){
+    if(fh < 0 || fh >= filenum || finfo[fh].isopen == false){
         logMessage(LOG_ERROR_LEVEL, "There is no opened file to close");
         return -1;
     }
 
-    //close file
+    //pack the partial last block (lctailpack), write out the tail buffer and
+    //the queued blocks; the file stays open if any of it fails
+    if(packtail(fh) || tailflush(fh) || delayflush(fh) || lcsched_run(1)){
+        logMessage(LOG_ERROR_LEVEL, "Failed writing queued blocks at close of %s", finfo[fh].fname);
+        return -1;
+    }
     finfo[fh].isopen = false;
 
     logMessage(LcDriverLLevel, "Closed file handle %d [%s]", fh, finfo[fh].fname);
+    lchist_record(LC_HIST_CLOSE, tstart);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lctruncate
+// Description  : Set the length of a file: blocks past the new end are freed
+//                (the rest of the last block is zeroed), a longer length
+//                leaves a hole
+//
+// Inputs       : fh - file handle of the file
+//                len - the new length
+// Outputs      : 0 if successful, -1 if failure
+
+int lctruncate( LcFHandle fh, size_t len ) {
+    char zeros[LC_DEVICE_BLOCK_SIZE];
+    uint32_t fblk = len / LC_DEVICE_BLOCK_SIZE;
+    int offset = len % LC_DEVICE_BLOCK_SIZE;
+    blkaddr *addr;
+
+    if(fh < 0 || fh >= filenum || finfo[fh].isopen == false){
+        logMessage(LOG_ERROR_LEVEL, "Failed to truncate: file handle is not valid or file is not opened");
+        return -1;
+    }
+
+    //inline file: zero the cut off bytes, or move into blocks to grow past the threshold
+    if(finfo[fh].inldata != NULL){
+        if(len <= (size_t)inlinemax){
+            if(len < (size_t)finfo[fh].flength){
+                memset(finfo[fh].inldata+len, 0x0, finfo[fh].flength-len);
+            }
+            finfo[fh].flength = len;
+            return 0;
+        }
+        if(inlinepromote(fh)){
+            return -1;
+        }
+    }
+    if(unpacktail(fh)){
+        return -1;
+    }
+
+    if(len < (size_t)finfo[fh].flength){
+        //zero the rest of the new last block so growing the file again reads zeros
+        addr = (fblk < (uint32_t)finfo[fh].mapsize) ? &finfo[fh].blkmap[fblk] : NULL;
+        if(offset > 0 && fblk == (uint32_t)finfo[fh].tailblk){
+            memset(finfo[fh].tail+offset, 0x0, LC_DEVICE_BLOCK_SIZE-offset);
+        }
+        else if(offset > 0 && addr != NULL && addr->dev != BLK_UNALLOCATED){
+            memset(zeros, 0x0, sizeof(zeros));
+            if(blockwrite(fh, fblk, offset, zeros, LC_DEVICE_BLOCK_SIZE-offset)){
+                return -1;
+            }
+        }
+        if(freeblocks(fh, (offset > 0) ? fblk+1 : fblk)){
+            return -1;
+        }
+    }
+
+    logMessage(LcDriverLLevel, "Truncated file %s from %d to %d bytes", finfo[fh].fname, finfo[fh].flength, len);
+    finfo[fh].flength = len;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdelete
+// Description  : Delete a (closed) file, freeing all its blocks
+//
+// Inputs       : path - the file to delete
+// Outputs      : 0 if successful, -1 if failure
+
+int lcdelete( const char *path ) {
+    int fd, r;
+
+    for(fd=1; fd<filenum && strcmp(path, finfo[fd].fname) != 0; fd++);
+    if(fd == filenum || isDeviceOn == false){
+        logMessage(LOG_ERROR_LEVEL, "Failed to delete [%s]: no such file", path);
+        return -1;
+    }
+    if(finfo[fd].isopen == true){
+        logMessage(LOG_ERROR_LEVEL, "Failed to delete [%s]: file is open", path);
+        return -1;
+    }
+    if(finfo[fd].packslot >= 0){
+        packfree(finfo[fd].packslot, finfo[fd].packoff, finfo[fd].flength % LC_DEVICE_BLOCK_SIZE);
+        finfo[fd].packslot = -1;
+    }
+    if(freeblocks(fd, 0)){
+        return -1;
+    }
+
+    //the handle can be reused
+    free(finfo[fd].blkmap);
+    free(finfo[fd].delayed);
+    free(finfo[fd].fname);
+    for(r=0; r<LC_MAX_COPIES-1; r++){
+        free(finfo[fd].mirror[r]);
+        finfo[fd].mirror[r] = NULL;
+    }
+    finfo[fd].copies = 1;
+    free(finfo[fd].parity);
+    finfo[fd].parity = NULL;
+    finfo[fd].width = 0;
+    finfo[fd].unit = 0;
+    free(finfo[fd].clmap);
+    finfo[fd].clmap = NULL;
+    finfo[fd].clmapsize = 0;
+    free(finfo[fd].inldata);
+    finfo[fd].inldata = NULL;
+    finfo[fd].fname = "\0";
+    finfo[fd].fhandle = -1;
+    finfo[fd].flength = -1;
+    finfo[fd].pos = -1;
+    finfo[fd].blkmap = NULL;
+    finfo[fd].mapsize = 0;
+    finfo[fd].delayed = NULL;
+    finfo[fd].ndelayed = 0;
+
+    logMessage(LcDriverLLevel, "Deleted file [%s], fh=%d", path, fd);
     return( 0 );
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsubmit
+// Description  : Run a batch of operations in order, as the blocking calls
+//                would, their completions going to the completion ring.
+//                Runs of reads (on any files) only queue their device
+//                reads, which are then issued together in one scheduler
+//                pass (merged and ordered across files and devices) before
+//                the next operation that is not a read.  Takes only as
+//                many operations as there is ring room for.
+//
+// Inputs       : ops - the operation descriptors
+//                n - number of operations
+// Outputs      : operations taken, -1 if failure
+
+int lcsubmit( LcSubmission *ops, int n ) {
+    int pend[LC_RING_ENTRIES], npend = 0, i, res;
+    LcFHandle pendfh[LC_RING_ENTRIES], fh, lastopen = -1;
+    uint32_t pendpos[LC_RING_ENTRIES], first = ctail;
+    uint64_t tstart = lchist_now();
+
+    if(ops == NULL || n < 0){
+        logMessage(LOG_ERROR_LEVEL, "Failed to submit: bad operation list");
+        return( -1 );
+    }
+    if(n > LC_RING_ENTRIES - (int)(ctail - chead)){
+        n = LC_RING_ENTRIES - (ctail - chead);
+    }
+
+    deferreads = true;
+    for(i=0; i<n; i++){
+        fh = (ops[i].fh == LC_SUBMIT_LASTOPEN) ? lastopen : ops[i].fh;
+
+        //the batched reads finish before anything that could change their blocks
+        if(ops[i].op != LC_OP_READ){
+            batchreads(ops, pend, pendfh, pendpos, npend, first);
+            npend = 0;
+        }
+
+        switch(ops[i].op){
+            case LC_OP_OPEN:
+                if((res = (ops[i].path == NULL) ? -1 : lcopen(ops[i].path)) != -1){
+                    lastopen = res;
+                }
+                break;
+            case LC_OP_READ:
+                pendpos[npend] = (fh > 0 && fh < filenum) ? finfo[fh].pos : 0;
+                deferred = 0;
+                if((res = lcread(fh, ops[i].buf, ops[i].len)) != -1 && deferred > 0){
+                    pend[npend] = i;
+                    pendfh[npend++] = fh;
+                }
+                break;
+            case LC_OP_WRITE:
+                res = lcwrite(fh, ops[i].buf, ops[i].len);
+                break;
+            case LC_OP_SEEK:
+                res = lcseek(fh, ops[i].len);
+                break;
+            case LC_OP_CLOSE:
+                res = lcclose(fh);
+                break;
+            default:
+                logMessage(LOG_ERROR_LEVEL, "Unknown submitted operation %u", ops[i].op);
+                res = -1;
+        }
+        cring[(first + i) % LC_RING_ENTRIES].tag = ops[i].tag;
+        cring[(first + i) % LC_RING_ENTRIES].res = res;
+    }
+    batchreads(ops, pend, pendfh, pendpos, npend, first);
+    deferreads = false;
+
+    ctail += n;
+    fsstats.submits++;
+    fsstats.submitted += n;
+    lchist_record(LC_HIST_SUBMIT, tstart);
+    return( n );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcpoll
+// Description  : Reap the completions of submitted operations (in
+//                submission order); never waits, lcsubmit has finished
+//                the operations by the time it returns
+//
+// Inputs       : cqes - where the completions go
+//                max - most completions wanted
+// Outputs      : completions reaped, -1 if failure
+
+int lcpoll( LcCompletion *cqes, int max ) {
+    int n = 0;
+
+    if(cqes == NULL || max < 0){
+        logMessage(LOG_ERROR_LEVEL, "Failed to poll: bad completion list");
+        return( -1 );
+    }
+    while(n < max && chead != ctail){
+        cqes[n++] = cring[chead++ % LC_RING_ENTRIES];
+    }
+    return( n );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : lcshutdown
@@ -808,29 +3111,69 @@ int lcclose( LcFHandle fh ) {
 // Outputs      : 0 if successful test, -1 if failure
 
 int lcshutdown( void ) {
-    int i;
+    int i, fd, ret = 0;
+
+    // place and write out everything still buffered or queued (powering off
+    // anyway if some of it fails)
+    for(fd=1; fd<filenum; fd++){
+        if(tailflush(fd) || delayflush(fd)){
+            logMessage(LOG_ERROR_LEVEL, "Failed writing buffered blocks of %s at shutdown", finfo[fd].fname);
+            ret = -1;
+        }
+    }
+    if(lcsched_close()){
+        logMessage(LOG_ERROR_LEVEL, "Failed writing queued blocks at shutdown");
+        ret = -1;
+    }
+    lcdedup_close();
 
     //////////////////////// free //////////////////////////
     int n=0;
     while(n<devicenum){
-        for(i = 0; i < devinfo[n].maxsec; i++){
-            free(devinfo[n].storage[i]);
-            free(devinfo[n].fileblktracker[i]);
-            free(devinfo[n].filepostracker[i]);
-        }      
-        free(devinfo[n].storage);    
-        free(devinfo[n].fileblktracker);
-        free(devinfo[n].filepostracker);
+        devmetafree(n);
         n++;
     }
 
     free(devinfo);
+
+    for(fd=0; fd<filenum; fd++){
+        free(finfo[fd].blkmap);
+        finfo[fd].blkmap = NULL;
+        finfo[fd].mapsize = 0;
+        free(finfo[fd].delayed);
+        finfo[fd].delayed = NULL;
+        finfo[fd].ndelayed = 0;
+        for(i=0; i<LC_MAX_COPIES-1; i++){
+            free(finfo[fd].mirror[i]);
+            finfo[fd].mirror[i] = NULL;
+        }
+        finfo[fd].copies = 1;
+        free(finfo[fd].parity);
+        finfo[fd].parity = NULL;
+        finfo[fd].width = 0;
+        finfo[fd].unit = 0;
+        free(finfo[fd].clmap);
+        finfo[fd].clmap = NULL;
+        finfo[fd].clmapsize = 0;
+        free(finfo[fd].inldata);
+        finfo[fd].inldata = NULL;
+        finfo[fd].packslot = -1;
+        if(finfo[fd].fname != NULL && finfo[fd].fname[0] != '\0'){
+            free(finfo[fd].fname);
+            finfo[fd].fname = "\0";
+        }
+    }
+    free(packs);
+    packs = NULL;
+    npacks = 0;
+    lastpack = -1;
+    delayedblocks = 0;
     ////////////////////////////////////////////////////////
 
 
     //Poweroff
     frm = create_lcloud_registers(0, 0 ,LC_POWER_OFF ,0, 0, 0, 0); 
-    lcloud_io_bus(frm, NULL);
+    io_bus(frm, NULL);
 
     // close cache
     lcloud_closecache();
@@ -840,5 +3183,356 @@ int lcshutdown( void ) {
 
     isDeviceOn = false;
 
+    return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcfragreport
+// Description  : Measure the fragmentation of a file: its placed blocks and
+//                the extents (contiguous device runs) they are in
+//
+// Inputs       : fh - the file, LC_DEFRAG_ALL for every file
+//                report - filled with the measurement
+// Outputs      : 0 if successful, -1 if failure
+
+int lcfragreport( LcFHandle fh, LcFragReport *report ) {
+    int fd;
+
+    if(report == NULL || isDeviceOn == false ||
+       (fh != LC_DEFRAG_ALL && (fh <= 0 || fh >= filenum || finfo[fh].fname[0] == '\0'))){
+        logMessage(LOG_ERROR_LEVEL, "Failed to measure fragmentation: bad file handle %d", fh);
+        return( -1 );
+    }
+    memset(report, 0x0, sizeof(LcFragReport));
+    for(fd=1; fd<filenum; fd++){
+        if((fh == LC_DEFRAG_ALL && finfo[fd].fname[0] != '\0') || fd == fh){
+            fragfile(fd, report);
+        }
+    }
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcdefrag
+// Description  : Compact a file (online): stretches of blocks spread over
+//                several extents are rewritten into contiguous runs
+//
+// Inputs       : fh - the file, LC_DEFRAG_ALL for every file
+//                before, after - filled with the fragmentation before and
+//                after (may be NULL)
+// Outputs      : 0 if successful, -1 if failure
+
+int lcdefrag( LcFHandle fh, LcFragReport *before, LcFragReport *after ) {
+    LcFragReport start, end;
+    uint64_t moved = 0;
+    int fd;
+
+    if(lcfragreport(fh, &start)){
+        return( -1 );
+    }
+    for(fd=1; fd<filenum; fd++){
+        if(((fh == LC_DEFRAG_ALL && finfo[fd].fname[0] != '\0') || fd == fh) && defragfile(fd, &moved)){
+            return( -1 );
+        }
+    }
+    if(lcsched_run(1)){
+        return( -1 );
+    }
+    lcfragreport(fh, &end);
+    end.moved = moved;
+    fsstats.defragpasses++;
+    fsstats.defragmoved += moved;
+
+    logMessage(LcDriverLLevel, "Defragmented %d files: %lu blocks in %lu extents -> %lu extents (%lu blocks moved)",
+        end.files, end.blocks, start.extents, end.extents, moved);
+    if(before != NULL){
+        *before = start;
+    }
+    if(after != NULL){
+        *after = end;
+    }
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lczeroholes
+// Description  : Store blocks written as all zeros as holes: they take no
+//                device block and read back as zeros without any I/O
+//
+// Inputs       : enable - non-zero to turn zero blocks into holes
+// Outputs      : 0 if successful, -1 if failure
+
+int lczeroholes( int enable ) {
+    zeroholes = (enable != 0);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcreplicate
+// Description  : Set the replication factor of an open file: each placed
+//                block is kept on copies distinct devices, written together
+//                and read from the least busy (healthy) one.  Raising it
+//                copies the blocks already placed, lowering it frees the
+//                extra replicas.
+//
+// Inputs       : fh - file handle of the file
+//                copies - 1 (no replicas) to LC_MAX_COPIES
+// Outputs      : 0 if successful, -1 if failure
+
+int lcreplicate( LcFHandle fh, int copies ) {
+    char data[LC_DEVICE_BLOCK_SIZE];
+    int i, r, old;
+
+    if(fh <= 0 || fh >= filenum || finfo[fh].isopen == false || copies < 1 ||
+       copies > LC_MAX_COPIES || copies > devicenum || (finfo[fh].unit > 0 && copies > 1)){
+        logMessage(LOG_ERROR_LEVEL, "Failed to replicate file handle %d %d times", fh, copies);
+        return( -1 );
+    }
+    old = finfo[fh].copies;
+
+    //replicas cover the file's own blocks only: a packed tail moves back first
+    if(copies > 1 && unpacktail(fh)){
+        return( -1 );
+    }
+
+    //fewer copies: give the extra replicas back
+    for(i=0; copies < old && i<finfo[fh].mapsize; i++){
+        mirrorfree(fh, i, copies-1);
+    }
+    for(r=copies-1; r<LC_MAX_COPIES-1; r++){
+        free(finfo[fh].mirror[r]);
+        finfo[fh].mirror[r] = NULL;
+    }
+
+    //more copies: new replica maps, then copy the placed blocks into them
+    for(r=old-1; r<copies-1; r++){
+        if(finfo[fh].mapsize > 0 && growmap(&finfo[fh].mirror[r], 0, finfo[fh].mapsize)){
+            logMessage(LOG_ERROR_LEVEL, "Failed to allocate replica map of file %s", finfo[fh].fname);
+            return( -1 );
+        }
+    }
+    finfo[fh].copies = copies;
+    for(i=0; copies > old && i<finfo[fh].mapsize; i++){
+        if(finfo[fh].blkmap[i].dev >= 0 && (getblock(&finfo[fh].blkmap[i], data) || mirrorwrite(fh, i, data))){
+            logMessage(LOG_ERROR_LEVEL, "Failed to replicate block %d of file %s", i, finfo[fh].fname);
+            return( -1 );
+        }
+    }
+
+    logMessage(LcDriverLLevel, "File %s now keeps %d copies of each block", finfo[fh].fname, copies);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcparity
+// Description  : Stripe a file in units of unit blocks over width data
+//                devices plus one rotating XOR parity device, so any one
+//                failed device can be read around.  The layout is fixed
+//                when the file is empty; not combined with lcreplicate.
+//
+// Inputs       : fh - the file handle
+//                width - data units per stripe (2..LC_PARITY_MAXWIDTH)
+//                unit - stripe unit in blocks (0 - no parity)
+// Outputs      : 0 if successful, -1 if failure
+
+int lcparity( LcFHandle fh, int width, int unit ) {
+    if(fh <= 0 || fh >= filenum || finfo[fh].isopen == false || unit < 0 || unit > LC_PARITY_MAXUNIT ||
+       (unit > 0 && (width < 2 || width > LC_PARITY_MAXWIDTH || width+1 > devicenum)) || finfo[fh].copies > 1){
+        logMessage(LOG_ERROR_LEVEL, "Failed to set parity stripe %dx%d on file handle %d", width, unit, fh);
+        return( -1 );
+    }
+    if(unit == finfo[fh].unit && (unit == 0 || width == finfo[fh].width)){
+        return( 0 );
+    }
+    if(finfo[fh].flength > 0){
+        logMessage(LOG_ERROR_LEVEL, "Cannot change the parity layout of non-empty file %s", finfo[fh].fname);
+        return( -1 );
+    }
+
+    free(finfo[fh].parity);
+    finfo[fh].parity = NULL;
+    if(unit > 0 && finfo[fh].mapsize > 0 && growmap(&finfo[fh].parity, 0, finfo[fh].mapsize)){
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate parity map of file %s", finfo[fh].fname);
+        return( -1 );
+    }
+    finfo[fh].width = (unit > 0) ? width : 0;
+    finfo[fh].unit = unit;
+
+    logMessage(LcDriverLLevel, "File %s now striped over %d units of %d blocks with parity (%s)",
+               finfo[fh].fname, width, unit, lcparity_kernel());
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcplacement
+// Description  : Select the device placement policy for new allocations
+//
+// Inputs       : policy - LC_PLACE_FILL or LC_PLACE_WEIGHTED
+// Outputs      : 0 if successful, -1 if failure
+
+int lcplacement( LcPlacePolicy policy ) {
+    if(policy >= LC_PLACE_MAXPOLICY){
+        logMessage(LOG_ERROR_LEVEL, "Unknown device placement policy %d", policy);
+        return( -1 );
+    }
+    placement = policy;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcinline
+// Description  : Keep new files inline (contents in the file record, no
+//                device blocks or bus transfers) until they grow past
+//                bytes; the threshold applies to files created afterwards
+//
+// Inputs       : bytes - largest inline file (0 - off)
+// Outputs      : 0 if successful, -1 if failure
+
+int lcinline( int bytes ) {
+    if(bytes < 0 || bytes > LC_INLINE_MAXBYTES){
+        logMessage(LOG_ERROR_LEVEL, "Bad inline file threshold %d bytes", bytes);
+        return( -1 );
+    }
+    inlinemax = bytes;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lccluster
+// Description  : Set the allocation cluster size: files get device blocks
+//                in aligned runs of blocks (reserved whole), later blocks
+//                of a cluster take their slot without an allocator search,
+//                and a read that misses brings in the rest of its cluster.
+//                Only while no device blocks are allocated.
+//
+// Inputs       : blocks - device blocks per cluster (1 - no clusters)
+// Outputs      : 0 if successful, -1 if failure
+
+int lccluster( int blocks ) {
+    if(blocks < 1 || blocks > LC_CLUSTER_MAXBLOCKS){
+        logMessage(LOG_ERROR_LEVEL, "Bad cluster size %d blocks", blocks);
+        return( -1 );
+    }
+    if(isDeviceOn && (allocatedblock > 0 || fsstats.clusterreserved > 0)){
+        logMessage(LOG_ERROR_LEVEL, "Cannot change the cluster size with blocks allocated");
+        return( -1 );
+    }
+    clusterblks = blocks;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lctailpack
+// Description  : Pack the partial last blocks of files (up to LC_PACK_MAXTAIL
+//                bytes) together at close: each tail takes a run of
+//                LC_PACK_GRANULE byte granules in a shared pack block instead
+//                of a device block of its own, and one cached pack block
+//                serves the tails of several small files.  A tail moves back
+//                into the file when it is written or truncated.
+//
+// Inputs       : enable - non-zero to pack the tails
+// Outputs      : 0 if successful, -1 if failure
+
+int lctailpack( int enable ) {
+    tailpack = (enable != 0);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_allocrun
+// Description  : Allocate up to n consecutive device blocks (in sector/block
+//                order on one device) for consecutive file blocks.  The first
+//                free run of n blocks is taken, looking first at the device
+//                the placement policy picks; if no device has one, the longest free run is taken
+//                and the caller allocates the rest with another call.  With
+//                a cluster size (lccluster) the blocks go in the file's
+//                clusters, reserved whole as they are first written.
+//
+// Inputs       : fh - the file handle the blocks belong to
+//                fblk - file block number of the first block
+//                n - blocks wanted
+//                dev, sec, blk - filled with the storage index/sector/block
+//                                of the first block
+// Outputs      : number of blocks allocated, -1 if all devices are full
+
+int lcloud_allocrun( LcFHandle fh, uint32_t fblk, int n, int *dev, int *sec, int *blk ) {
+    return( allocdata(fh, fblk, n, 0, dev, sec, blk) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_allocblk
+// Description  : Allocate a device block for a file block, filling the current
+//                device before moving onto the next one
+//
+// Inputs       : fh - the file handle the block belongs to
+//                fblk - file block number (filepos/256)
+//                dev, sec, blk - filled with the storage index/sector/block
+// Outputs      : 0 if successful, -1 if all devices are full
+
+int lcloud_allocblk( LcFHandle fh, uint32_t fblk, int *dev, int *sec, int *blk ) {
+    return( (lcloud_allocrun(fh, fblk, 1, dev, sec, blk) == 1) ? 0 : -1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcloud_freeblk
+// Description  : Return a device block to the allocator
+//
+// Inputs       : dev, sec, blk - storage index/sector/block of the block
+// Outputs      : 0 if successful, -1 if failure
+
+int lcloud_freeblk( int dev, int sec, int blk ) {
+
+    if(dev < 0 || dev >= devicenum || sec < 0 || sec >= devinfo[dev].maxsec ||
+       blk < 0 || blk >= devinfo[dev].maxblk || devinfo[dev].storage == NULL || devinfo[dev].storage[sec][blk] == 0){
+        logMessage(LOG_ERROR_LEVEL, "Failed to free block [%d/%d/%d]: not allocated", dev, sec, blk);
+        return( -1 );
+    }
+
+    devinfo[dev].storage[sec][blk] = 0;
+    devinfo[dev].fileblktracker[sec][blk] = 0;
+    devinfo[dev].filepostracker[sec][blk] = 0;
+    fsstats.devices[dev].free = ++devinfo[dev].nfree;
+    allocatedblock--;
+    fsstats.frees++;
+    logMessage(LcDriverLLevel, "Freed block [%d/%d/%d]", devinfo[dev].did, sec, blk);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcstats
+// Description  : Get the filesystem performance counters (since last power on)
+//
+// Inputs       : stats - structure to fill with the counters
+// Outputs      : 0 if successful test, -1 if failure
+
+int lcstats( LcStats *stats ) {
+
+    if(stats == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failed to get stats: NULL stats structure");
+        return -1;
+    }
+
+    memcpy(stats, &fsstats, sizeof(LcStats));
+    lcloud_cachestats(&stats->cache);
+    lcsched_stats(&stats->sched);
+    lcdedup_stats(&stats->dedup);
+    stats->placement = placement;
+    stats->clusterblocks = clusterblks;
+    stats->inlinemax = inlinemax;
+    stats->tailpack = tailpack;
+
     return( 0 );
 }
@@ -16,10 +16,200 @@
 #include <stdint.h>
 
 // Defines 
+#define LC_STATS_MAXDEVICES 16  // Max devices reported in the stats
+#define LC_STATS_MAXFILES 33    // Max files reported in the stats (file table size)
+#define LC_STATS_MAXNAME 128    // Max file name length kept in the stats
+#define LC_STATS_MAXBUSOPS 5    // Number of bus operation codes (LC_MAX_OPERATION)
+#define LC_DEFRAG_ALL -1        // lcfragreport/lcdefrag: every file
+#define LC_DEFRAG_BATCH 32      // blocks read and rewritten together by lcdefrag
+#define LC_PLACE_QUEUESCALE 16  // queued requests that halve a device's weighted placement share
+#define LC_MAX_COPIES 3         // lcreplicate: most copies kept of each file block
+#define LC_DEVICE_RECOVERXFERS 16 // successful transfers that work off one failed transfer of a device
+#define LC_PARITY_MAXWIDTH 8    // lcparity: most data units per stripe (plus one parity unit)
+#define LC_PARITY_MAXUNIT 64    // lcparity: largest stripe unit (blocks)
+#define LC_CLUSTER_MAXBLOCKS 64 // lccluster: largest allocation cluster (blocks)
+#define LC_CLUSTER_READSHARE 16 // lccluster: a cluster read-in takes at most 1/16 of the cache
+#define LC_INLINE_MAXBYTES 256  // lcinline: largest inline file (one device block)
+#define LC_PACK_GRANULE 16      // lctailpack: tails are packed in 16 byte granules (16 per block)
+#define LC_PACK_MAXTAIL 192     // lctailpack: longest tail packed (longer tails keep their block)
+#define LC_RING_ENTRIES 256     // lcsubmit/lcpoll: completions held until reaped
+#define LC_SUBMIT_LASTOPEN -2   // lcsubmit: handle of the last open in the same submission
 
 // Type definitions
 typedef int32_t LcFHandle;
 
+// Device placement policies for new allocations (lcplacement)
+typedef enum {
+    LC_PLACE_FILL      = 0,   // fill the current device, then move onto the next
+    LC_PLACE_WEIGHTED  = 1,   // spread over the devices by free capacity and queue depth
+    LC_PLACE_MAXPOLICY = 2
+} LcPlacePolicy;
+extern const char *LC_PLACE_POLICY_LABELS[LC_PLACE_MAXPOLICY];
+
+// Batched operations (lcsubmit)
+typedef enum {
+    LC_OP_OPEN  = 0,   // open path
+    LC_OP_READ  = 1,   // read len bytes into buf
+    LC_OP_WRITE = 2,   // write len bytes from buf
+    LC_OP_SEEK  = 3,   // seek to offset len
+    LC_OP_CLOSE = 4,   // close
+    LC_OP_MAX   = 5
+} LcOpcode;
+
+// An operation descriptor (filled in by the caller)
+typedef struct {
+    uint32_t    op;     // LcOpcode
+    LcFHandle   fh;     // file handle (or LC_SUBMIT_LASTOPEN), not used by LC_OP_OPEN
+    const char *path;   // LC_OP_OPEN: the file
+    char       *buf;    // LC_OP_READ/LC_OP_WRITE: the data (untouched until reaped)
+    size_t      len;    // LC_OP_READ/LC_OP_WRITE: bytes, LC_OP_SEEK: offset
+    uint64_t    tag;    // caller's cookie, returned with the completion
+} LcSubmission;
+
+// An operation completion (reaped with lcpoll)
+typedef struct {
+    uint64_t tag;       // tag of the operation
+    int      res;       // what the blocking call returns (handle, bytes, offset, 0), -1 if failure
+} LcCompletion;
+
+// Per-device counters
+typedef struct {
+    uint8_t  did;           // device id
+    uint32_t maxsec;        // sectors on the device
+    uint32_t maxblk;        // blocks per sector
+    uint64_t reads;         // block reads issued to the device
+    uint64_t writes;        // block writes issued to the device
+    uint64_t bytesread;     // bytes transferred from the device
+    uint64_t byteswritten;  // bytes transferred to the device
+    uint64_t allocated;     // blocks allocated on the device
+    uint32_t free;          // blocks currently free on the device
+    uint64_t errors;        // failed transfers (replica reads avoid the device)
+} LcDeviceStats;
+
+// Per-file counters
+typedef struct {
+    LcFHandle fh;                   // file handle
+    char     name[LC_STATS_MAXNAME]; // file name
+    uint64_t opens;                 // number of opens
+    uint64_t reads;                 // number of lcread calls
+    uint64_t writes;                // number of lcwrite calls
+    uint64_t seeks;                 // number of lcseek calls
+    uint64_t bytesread;             // bytes returned to the application
+    uint64_t byteswritten;          // bytes accepted from the application
+    uint64_t tailwrites;            // write pieces absorbed by the tail buffer
+    uint64_t tailflushes;           // tail buffer blocks written out
+} LcFileStats;
+
+// Cache counters
+typedef struct {
+    uint64_t hits;          // lookups found in the cache
+    uint64_t misses;        // lookups not found in the cache
+    uint64_t evictions;     // items ejected to make room
+    uint64_t prefetches;    // items loaded ahead of use
+    uint64_t inserts;       // new items added to the cache
+    uint64_t rejected;      // new items refused by the admission filter
+    uint32_t items;         // items currently cached
+    uint32_t maxitems;      // cache capacity (in blocks)
+    uint64_t l2hits;        // cache misses found in the L2 victim cache
+    uint64_t l2misses;      // cache misses not in the L2 victim cache either
+    uint64_t l2inserts;     // evicted items moved into the L2 victim cache
+    uint64_t l2evictions;   // items ejected from the L2 victim cache
+    uint32_t l2items;       // items currently in the L2 victim cache
+    uint32_t l2maxitems;    // L2 victim cache capacity (0 if disabled)
+    uint64_t zhits;         // cache misses found in the compressed tier
+    uint64_t zinserts;      // evicted items compressed into the compressed tier
+    uint64_t zevictions;    // items ejected from the compressed tier
+    uint32_t zitems;        // items currently compressed
+    uint32_t zstored;       // bytes held by the compressed items
+    uint32_t zcapacity;     // compressed tier size in bytes (0 if disabled)
+    uint64_t zcompressns;   // time spent compressing (ns)
+    uint64_t zdecompressns; // time spent decompressing (ns)
+} LcCacheStats;
+
+// I/O scheduler counters
+typedef struct {
+    uint32_t policy;        // dispatch policy (LcSchedPolicy)
+    uint64_t queued;        // requests added to the device queues
+    uint64_t dispatched;    // requests sent to the devices
+    uint64_t merges;        // reads merged into an already queued read
+    uint64_t superseded;    // queued writes replaced by a later write
+    uint64_t forwarded;     // reads satisfied from a queued write
+    uint64_t reorders;      // requests dispatched ahead of an earlier arrival
+    uint64_t expired;       // dispatches forced by the max queue latency
+    uint64_t retried;       // failed writes kept queued to go out again
+    uint32_t maxdepth;      // deepest any device queue has been
+} LcSchedStats;
+
+// Deduplication counters
+typedef struct {
+    uint32_t enabled;       // deduplication is on
+    uint64_t lookups;       // placed blocks looked up by contents
+    uint64_t hits;          // blocks shared instead of written
+    uint64_t collisions;    // fast hash matches the crypto hash rejected
+    uint64_t releases;      // references dropped by overwrites
+    uint64_t unshares;      // references dropped from shared blocks (overwrites copy the block)
+    uint32_t entries;       // blocks indexed
+    uint32_t shared;        // indexed blocks with more than one reference
+} LcDedupStats;
+
+// File fragmentation (lcfragreport/lcdefrag)
+typedef struct {
+    uint32_t files;         // files measured
+    uint64_t blocks;        // device blocks mapped
+    uint64_t extents;       // runs of consecutive file blocks in consecutive device blocks
+    uint64_t moved;         // blocks relocated
+} LcFragReport;
+
+// Filesystem performance counters (since last power on)
+typedef struct {
+    uint64_t      bustransactions;                // total frames sent on the bus
+    uint64_t      busops[LC_STATS_MAXBUSOPS];     // frames by operation code
+    uint64_t      allocations;                    // blocks allocated
+    uint64_t      frees;                          // blocks returned to the allocator
+    uint64_t      allocruns;                      // contiguous runs handed out by the allocator
+    uint32_t      placement;                      // device placement policy (LcPlacePolicy)
+    uint32_t      clusterblocks;                  // device blocks per allocation cluster (lccluster)
+    uint64_t      clusterallocs;                  // clusters reserved for files
+    uint64_t      clusterhits;                    // allocations served from a cluster the file held
+    uint64_t      clusterreads;                   // blocks read in with the rest of their cluster
+    uint32_t      clusterreserved;                // blocks reserved in clusters, not yet written
+    uint32_t      inlinemax;                      // largest inline file in bytes (lcinline, 0 off)
+    uint32_t      inlinefiles;                    // files created inline
+    uint64_t      inlinereads;                    // reads served from the file record
+    uint64_t      inlinewrites;                   // writes kept in the file record
+    uint64_t      inlinepromotions;               // inline files moved into blocks
+    uint32_t      tailpack;                       // partial last blocks are packed (lctailpack)
+    uint64_t      packedtails;                    // tails moved into shared pack blocks
+    uint64_t      unpackedtails;                  // tails moved back into a block of their own
+    uint64_t      packreads;                      // reads served from a pack block
+    uint32_t      packblocks;                     // pack blocks in use
+    uint32_t      packbytes;                      // tail bytes held in the pack blocks
+    uint64_t      submits;                        // lcsubmit calls
+    uint64_t      submitted;                      // operations submitted
+    uint64_t      batchruns;                      // scheduler runs issuing the device reads of a batch
+    uint64_t      batchedreads;                   // reads whose device reads went out with the rest of their batch
+    uint64_t      holereads;                      // hole blocks read as zeros (no I/O)
+    uint64_t      delayedreads;                   // blocks read from their delayed slot (written, not yet placed)
+    uint64_t      defragpasses;                   // lcdefrag calls
+    uint64_t      defragmoved;                    // blocks relocated by lcdefrag
+    uint64_t      zeroholes;                      // all-zero blocks written as holes
+    uint64_t      mirrorwrites;                   // replica block writes (lcreplicate)
+    uint64_t      mirrorreads;                    // block reads routed to a replica
+    uint64_t      failovers;                      // reads retried on the other copies after a failure
+    uint64_t      parityfull;                     // parity rows computed from newly written data only
+    uint64_t      paritypartial;                  // parity rows that read the rest of the row first
+    uint64_t      paritywrites;                   // parity block writes
+    uint64_t      degradedreads;                  // blocks rebuilt from parity (device with failures)
+    uint64_t      totalblocks;                    // blocks available on all devices
+    LcCacheStats  cache;                          // cache counters
+    LcSchedStats  sched;                          // I/O scheduler counters
+    LcDedupStats  dedup;                          // deduplication counters
+    int           numdevices;                     // valid entries in devices
+    LcDeviceStats devices[LC_STATS_MAXDEVICES];   // per-device counters
+    int           numfiles;                       // valid entries in files
+    LcFileStats   files[LC_STATS_MAXFILES];       // per-file counters (by handle)
+} LcStats;
+
 // File system interface definitions
 
 LcFHandle lcopen( const char *path );
@@ -37,7 +227,60 @@ int lcseek( LcFHandle fh, size_t off );
 int lcclose( LcFHandle fh );
     // Close the file
 
+int lctruncate( LcFHandle fh, size_t len );
+    // Shrink (freeing blocks) or extend (with a hole) an open file
+
+int lcdelete( const char *path );
+    // Delete a closed file, freeing its blocks
+
 int lcshutdown( void );
     // Shut down the filesystem
 
+int lcsubmit( LcSubmission *ops, int n );
+    // Run a batch of operations (device reads issued together), completions go to the ring
+
+int lcpoll( LcCompletion *cqes, int max );
+    // Reap up to max completions of submitted operations
+
+int lcstats( LcStats *stats );
+    // Get the filesystem performance counters
+
+int lcfragreport( LcFHandle fh, LcFragReport *report );
+    // Measure the fragmentation of a file (LC_DEFRAG_ALL for every file)
+
+int lcdefrag( LcFHandle fh, LcFragReport *before, LcFragReport *after );
+    // Relocate a file's blocks into contiguous extents (LC_DEFRAG_ALL for every file)
+
+int lczeroholes( int enable );
+    // Store blocks written as all zeros as holes (no device block)
+
+int lcreplicate( LcFHandle fh, int copies );
+    // Keep copies (1..LC_MAX_COPIES) of each block of a file on distinct devices
+
+int lcparity( LcFHandle fh, int width, int unit );
+    // Stripe an empty file over width units of unit blocks with rotating XOR parity (0 - off)
+
+int lcplacement( LcPlacePolicy policy );
+    // Select the device placement policy for new allocations
+
+int lcinline( int bytes );
+    // Keep new files of up to bytes bytes in their file record (no device blocks)
+
+int lccluster( int blocks );
+    // Allocate (and read in) file blocks in aligned clusters of blocks device blocks
+
+int lctailpack( int enable );
+    // Pack the partial last blocks of closed files together into shared blocks
+
+// Block allocator interface (used by the filesystem and the microbenchmarks)
+
+int lcloud_allocblk( LcFHandle fh, uint32_t fblk, int *dev, int *sec, int *blk );
+    // Allocate a device block (storage index/sector/block) for a file block
+
+int lcloud_allocrun( LcFHandle fh, uint32_t fblk, int n, int *dev, int *sec, int *blk );
+    // Allocate up to n consecutive device blocks for consecutive file blocks
+
+int lcloud_freeblk( int dev, int sec, int blk );
+    // Return a device block to the allocator
+
 #endif
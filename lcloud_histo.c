@@ -0,0 +1,247 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_histo.c
+//  Description    : This is the latency histogram implementation for the
+//                   LionCloud filesystem.  Each thread records into its own
+//                   log-linear (HDR-style) histograms without locking, and
+//                   the histograms are merged when a summary is requested.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <cmpsc311_log.h>
+#include <lcloud_histo.h>
+
+// per-thread histogram set
+typedef struct histset{
+    uint64_t counts[LC_HIST_MAX][LC_HIST_BUCKETS];
+    uint64_t total[LC_HIST_MAX];   // number of samples
+    uint64_t sum[LC_HIST_MAX];     // sum of samples (for the mean)
+    uint64_t min[LC_HIST_MAX];
+    uint64_t max[LC_HIST_MAX];
+    struct histset *next;          // next registered thread set
+}histset;
+
+const char *LC_HIST_LABELS[LC_HIST_MAX] = {
+    "bus_power_on", "bus_devprobe", "bus_devinit", "bus_block_xfer", "bus_power_off",
+    "getcache", "putcache",
+    "lcopen", "lcread", "lcwrite", "lcseek", "lcclose",
+    "lcsubmit"
+};
+
+static __thread histset *localhist = NULL;  // this thread's histograms
+static histset *histlist = NULL;            // all registered histograms
+static pthread_mutex_t histlock = PTHREAD_MUTEX_INITIALIZER;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hist_bucket
+// Description  : map a value to its bucket: values below LC_HIST_SUBBUCKETS
+//                are exact, above that each power of two is split into
+//                LC_HIST_HALFBUCKETS even buckets
+//
+// Inputs       : val - the value (ns)
+// Outputs      : bucket index
+
+static int hist_bucket(uint64_t val){
+    int msb, shift, idx;
+
+    if(val < LC_HIST_SUBBUCKETS){
+        return (int)val;
+    }
+    msb = 63 - __builtin_clzll(val);
+    shift = msb - LC_HIST_SUBBITS + 1;
+    idx = LC_HIST_SUBBUCKETS + (shift - 1) * LC_HIST_HALFBUCKETS + (int)((val >> shift) - LC_HIST_HALFBUCKETS);
+    if(idx >= LC_HIST_BUCKETS){
+        idx = LC_HIST_BUCKETS - 1;
+    }
+    return idx;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hist_value
+// Description  : highest value that maps into a bucket
+//
+// Inputs       : idx - bucket index
+// Outputs      : value (ns)
+
+static uint64_t hist_value(int idx){
+    int shift;
+    uint64_t sub;
+
+    if(idx < LC_HIST_SUBBUCKETS){
+        return idx;
+    }
+    shift = (idx - LC_HIST_SUBBUCKETS) / LC_HIST_HALFBUCKETS + 1;
+    sub = ((idx - LC_HIST_SUBBUCKETS) % LC_HIST_HALFBUCKETS) + LC_HIST_HALFBUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hist_local
+// Description  : get (creating and registering on first use) this thread's set
+//
+// Outputs      : the histogram set, NULL if failure
+
+static histset *hist_local(void){
+    int i;
+
+    if(localhist != NULL){
+        return localhist;
+    }
+    if((localhist = (histset *)calloc(1, sizeof(histset))) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate latency histograms");
+        return NULL;
+    }
+    for(i=0; i<LC_HIST_MAX; i++){
+        localhist->min[i] = UINT64_MAX;
+    }
+
+    pthread_mutex_lock(&histlock);
+    localhist->next = histlist;
+    histlist = localhist;
+    pthread_mutex_unlock(&histlock);
+    return localhist;
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lchist_now
+// Description  : Get the current monotonic time in ns
+//
+// Outputs      : time (ns)
+
+uint64_t lchist_now( void ) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lchist_record
+// Description  : Record the time elapsed since start in the histogram
+//
+// Inputs       : id - the histogram to record in
+//                start - start time (from lchist_now)
+// Outputs      : none
+
+void lchist_record( LcHistId id, uint64_t start ) {
+    histset *hs;
+    uint64_t val = lchist_now() - start;
+
+    if(id >= LC_HIST_MAX || (hs = hist_local()) == NULL){
+        return;
+    }
+    hs->counts[id][hist_bucket(val)]++;
+    hs->total[id]++;
+    hs->sum[id] += val;
+    if(val < hs->min[id]) hs->min[id] = val;
+    if(val > hs->max[id]) hs->max[id] = val;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lchist_summary
+// Description  : Merge the per-thread histograms and compute the percentiles
+//
+// Inputs       : id - the histogram to summarize
+//                sum - structure to fill with the summary
+// Outputs      : 0 if successful, -1 if failure
+
+int lchist_summary( LcHistId id, LcHistSummary *sum ) {
+    static uint64_t merged[LC_HIST_BUCKETS];
+    uint64_t total = 0, seen = 0, sumval = 0, p50, p90, p99, p999;
+    histset *hs;
+    int i;
+
+    if(id >= LC_HIST_MAX || sum == NULL){
+        return( -1 );
+    }
+
+    // merge all of the thread histograms
+    memset(merged, 0x0, sizeof(merged));
+    memset(sum, 0x0, sizeof(LcHistSummary));
+    sum->min = UINT64_MAX;
+    pthread_mutex_lock(&histlock);
+    for(hs=histlist; hs!=NULL; hs=hs->next){
+        for(i=0; i<LC_HIST_BUCKETS; i++){
+            merged[i] += hs->counts[id][i];
+        }
+        total += hs->total[id];
+        sumval += hs->sum[id];
+        if(hs->min[id] < sum->min) sum->min = hs->min[id];
+        if(hs->max[id] > sum->max) sum->max = hs->max[id];
+    }
+    pthread_mutex_unlock(&histlock);
+
+    if(total == 0){
+        sum->min = 0;
+        return( 0 );
+    }
+    sum->count = total;
+    sum->mean = (double)sumval / (double)total;
+
+    // walk the buckets to the rank of each percentile
+    p50 = (total * 500 + 999) / 1000;
+    p90 = (total * 900 + 999) / 1000;
+    p99 = (total * 990 + 999) / 1000;
+    p999 = (total * 999 + 999) / 1000;
+    for(i=0; i<LC_HIST_BUCKETS; i++){
+        if(merged[i] == 0){
+            continue;
+        }
+        seen += merged[i];
+        if(sum->p50 == 0 && seen >= p50) sum->p50 = hist_value(i);
+        if(sum->p90 == 0 && seen >= p90) sum->p90 = hist_value(i);
+        if(sum->p99 == 0 && seen >= p99) sum->p99 = hist_value(i);
+        if(sum->p999 == 0 && seen >= p999) sum->p999 = hist_value(i);
+    }
+
+    // the bucket bound can overshoot the real extremes
+    if(sum->p50 > sum->max) sum->p50 = sum->max;
+    if(sum->p90 > sum->max) sum->p90 = sum->max;
+    if(sum->p99 > sum->max) sum->p99 = sum->max;
+    if(sum->p999 > sum->max) sum->p999 = sum->max;
+
+    /* Return successfully */
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lchist_reset
+// Description  : Clear all of the histograms
+//
+// Outputs      : none
+
+void lchist_reset( void ) {
+    histset *hs;
+    int i;
+
+    pthread_mutex_lock(&histlock);
+    for(hs=histlist; hs!=NULL; hs=hs->next){
+        memset(hs->counts, 0x0, sizeof(hs->counts));
+        memset(hs->total, 0x0, sizeof(hs->total));
+        memset(hs->sum, 0x0, sizeof(hs->sum));
+        memset(hs->max, 0x0, sizeof(hs->max));
+        for(i=0; i<LC_HIST_MAX; i++){
+            hs->min[i] = UINT64_MAX;
+        }
+    }
+    pthread_mutex_unlock(&histlock);
+}
@@ -0,0 +1,72 @@
+#ifndef LCLOUD_HISTO_INCLUDED
+#define LCLOUD_HISTO_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_histo.h
+//  Description    : This is the latency histogram API for the LionCloud
+//                   filesystem (bus, cache and filesystem call timings).
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define LC_HIST_SUBBITS 7                              // values below 2^7 ns are counted exactly
+#define LC_HIST_SUBBUCKETS (1 << LC_HIST_SUBBITS)      // exact (linear) buckets
+#define LC_HIST_HALFBUCKETS (LC_HIST_SUBBUCKETS / 2)   // buckets per power of two above that (~1.6% error)
+#define LC_HIST_MAXBITS 40                             // largest value tracked is 2^40 ns (~18 min)
+#define LC_HIST_BUCKETS (LC_HIST_SUBBUCKETS + (LC_HIST_MAXBITS - LC_HIST_SUBBITS) * LC_HIST_HALFBUCKETS)
+
+// The timed operations
+typedef enum {
+    LC_HIST_BUS_POWER_ON   = 0,   // lcloud_io_bus, LC_POWER_ON
+    LC_HIST_BUS_DEVPROBE   = 1,   // lcloud_io_bus, LC_DEVPROBE
+    LC_HIST_BUS_DEVINIT    = 2,   // lcloud_io_bus, LC_DEVINIT
+    LC_HIST_BUS_BLOCK_XFER = 3,   // lcloud_io_bus, LC_BLOCK_XFER
+    LC_HIST_BUS_POWER_OFF  = 4,   // lcloud_io_bus, LC_POWER_OFF
+    LC_HIST_GETCACHE       = 5,   // lcloud_getcache
+    LC_HIST_PUTCACHE       = 6,   // lcloud_putcache
+    LC_HIST_OPEN           = 7,   // lcopen
+    LC_HIST_READ           = 8,   // lcread
+    LC_HIST_WRITE          = 9,   // lcwrite
+    LC_HIST_SEEK           = 10,  // lcseek
+    LC_HIST_CLOSE          = 11,  // lcclose
+    LC_HIST_SUBMIT         = 12,  // lcsubmit
+    LC_HIST_MAX            = 13   // Maximum histogram number
+} LcHistId;
+
+// Summary of one histogram (merged over all threads), values in ns
+typedef struct {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double   mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+} LcHistSummary;
+
+/* C string labels for the histograms */
+extern const char *LC_HIST_LABELS[LC_HIST_MAX];
+
+//
+// Functional Prototypes
+
+uint64_t lchist_now( void );
+    // Get the current monotonic time in ns
+
+void lchist_record( LcHistId id, uint64_t start );
+    // Record the time elapsed since start (from lchist_now) in the histogram
+
+int lchist_summary( LcHistId id, LcHistSummary *sum );
+    // Merge the per-thread histograms and compute the percentiles
+
+void lchist_reset( void );
+    // Clear all of the histograms
+
+#endif
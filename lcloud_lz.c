@@ -0,0 +1,207 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_lz.c
+//  Description    : This is the LZ77 codec for the LionCloud compressed cache
+//                   tier: greedy hash-table matching, byte aligned output.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <string.h>
+
+#include <lcloud_lz.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lz_read32
+// Description  : read 4 unaligned bytes
+
+static uint32_t lz_read32(const uint8_t *p){
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lz_hash
+// Description  : match finder table slot of the 4 bytes at p
+
+static uint32_t lz_hash(const uint8_t *p){
+    return (lz_read32(p) * 2654435761U) >> (32 - LC_LZ_HASHBITS);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lz_putlen
+// Description  : write the continuation bytes of a length whose nibble was 15
+//
+// Outputs      : new output position, -1 if out of room
+
+static int lz_putlen(uint8_t *dst, int op, int dstcap, int len){
+    for(; len >= 255; len -= 255){
+        if(op >= dstcap){
+            return -1;
+        }
+        dst[op++] = 255;
+    }
+    if(op >= dstcap){
+        return -1;
+    }
+    dst[op++] = (uint8_t)len;
+    return op;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lz_sequence
+// Description  : write one sequence: nlit literals from lit, then a match of
+//                mlen bytes at offset back (mlen 0 for the last sequence)
+//
+// Outputs      : new output position, -1 if out of room
+
+static int lz_sequence(uint8_t *dst, int op, int dstcap, const uint8_t *lit, int nlit, int offset, int mlen){
+    int token;
+
+    if(op >= dstcap){
+        return -1;
+    }
+    token = op++;
+    dst[token] = (uint8_t)(((nlit < 15) ? nlit : 15) << 4);
+    if(nlit >= 15 && (op = lz_putlen(dst, op, dstcap, nlit - 15)) == -1){
+        return -1;
+    }
+    if(op + nlit > dstcap){
+        return -1;
+    }
+    memcpy(&dst[op], lit, nlit);
+    op += nlit;
+    if(mlen == 0){
+        return op;
+    }
+
+    mlen -= LC_LZ_MINMATCH;
+    dst[token] |= (uint8_t)((mlen < 15) ? mlen : 15);
+    if(op + 2 > dstcap){
+        return -1;
+    }
+    dst[op++] = (uint8_t)(offset & 0xff);
+    dst[op++] = (uint8_t)(offset >> 8);
+    if(mlen >= 15 && (op = lz_putlen(dst, op, dstcap, mlen - 15)) == -1){
+        return -1;
+    }
+    return op;
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lclz_compress
+// Description  : Compress a buffer
+//
+// Inputs       : src/srclen - data to compress (at most LC_LZ_MAXINPUT bytes)
+//                dst/dstcap - output buffer
+// Outputs      : compressed length, -1 if it does not fit in dstcap
+
+int lclz_compress( const char *src, int srclen, char *dst, int dstcap ) {
+    const uint8_t *in = (const uint8_t *)src;
+    uint16_t table[1 << LC_LZ_HASHBITS]; // position + 1 of the last 4 bytes seen per slot (0 if none)
+    int ip = 0, anchor = 0, op = 0;
+    int ref, mlen;
+    uint32_t h;
+
+    if(srclen < 0 || srclen > LC_LZ_MAXINPUT){
+        return( -1 );
+    }
+    memset(table, 0x0, sizeof(table));
+
+    while(ip + LC_LZ_MINMATCH <= srclen){
+        h = lz_hash(&in[ip]);
+        ref = table[h] - 1;
+        table[h] = (uint16_t)(ip + 1);
+        if(ref < 0 || lz_read32(&in[ref]) != lz_read32(&in[ip])){
+            ip++;
+            continue;
+        }
+
+        // extend the match and emit the literals before it
+        for(mlen=LC_LZ_MINMATCH; ip + mlen < srclen && in[ref + mlen] == in[ip + mlen]; mlen++);
+        if((op = lz_sequence((uint8_t *)dst, op, dstcap, &in[anchor], ip - anchor, ip - ref, mlen)) == -1){
+            return( -1 );
+        }
+        ip += mlen;
+        anchor = ip;
+    }
+
+    // the rest is literals
+    return( lz_sequence((uint8_t *)dst, op, dstcap, &in[anchor], srclen - anchor, 0, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lclz_decompress
+// Description  : Decompress a buffer
+//
+// Inputs       : src/srclen - compressed data
+//                dst/dstcap - output buffer
+// Outputs      : decompressed length, -1 if src is malformed or does not fit
+
+int lclz_decompress( const char *src, int srclen, char *dst, int dstcap ) {
+    const uint8_t *in = (const uint8_t *)src;
+    uint8_t *out = (uint8_t *)dst;
+    int ip = 0, op = 0;
+    int token, len, offset, i;
+
+    while(ip < srclen){
+        token = in[ip++];
+
+        // literals
+        len = token >> 4;
+        if(len == 15){
+            do{
+                if(ip >= srclen){
+                    return( -1 );
+                }
+                len += in[ip];
+            }while(in[ip++] == 255);
+        }
+        if(ip + len > srclen || op + len > dstcap){
+            return( -1 );
+        }
+        memcpy(&out[op], &in[ip], len);
+        ip += len;
+        op += len;
+        if(ip == srclen){
+            break;  // last sequence
+        }
+
+        // match (may overlap its own output, so copy bytewise)
+        if(ip + 2 > srclen){
+            return( -1 );
+        }
+        offset = in[ip] | (in[ip+1] << 8);
+        ip += 2;
+        len = token & 0xf;
+        if(len == 15){
+            do{
+                if(ip >= srclen){
+                    return( -1 );
+                }
+                len += in[ip];
+            }while(in[ip++] == 255);
+        }
+        len += LC_LZ_MINMATCH;
+        if(offset == 0 || offset > op || op + len > dstcap){
+            return( -1 );
+        }
+        for(i=0; i<len; i++, op++){
+            out[op] = out[op - offset];
+        }
+    }
+    return( op );
+}
@@ -0,0 +1,42 @@
+#ifndef LCLOUD_LZ_INCLUDED
+#define LCLOUD_LZ_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_lz.h
+//  Description    : This is a small, fast LZ77 codec for the LionCloud
+//                   compressed cache tier (no external dependencies).
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define LC_LZ_MINMATCH 4       // shortest match encoded
+#define LC_LZ_HASHBITS 10      // match finder table size (2^bits entries)
+#define LC_LZ_MAXINPUT 65535   // largest input (matches use 16-bit offsets)
+
+//
+// Stream format: a series of sequences, each
+//
+//   token | [literal length bytes] | literals | offset (2 bytes LE) | [match length bytes]
+//
+// where the token's high nibble is the literal count and its low nibble the
+// match length - LC_LZ_MINMATCH; a nibble of 15 is continued by bytes that
+// are added to it (255 means another byte follows).  The last sequence has
+// only literals and ends the stream.
+//
+
+//
+// Functional Prototypes
+
+int lclz_compress( const char *src, int srclen, char *dst, int dstcap );
+    // Compress src into dst (compressed length, -1 if it does not fit in dstcap)
+
+int lclz_decompress( const char *src, int srclen, char *dst, int dstcap );
+    // Decompress src into dst (decompressed length, -1 if src is malformed or too big)
+
+#endif
@@ -0,0 +1,355 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_microbench.c
+//  Description    : This is the microbenchmark driver for the LionCloud
+//                   block cache and block allocator.  It drives the cache
+//                   with synthetic key streams at several cache sizes and
+//                   the allocator with allocation/free patterns on the
+//                   device metadata, without running whole workloads.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <lcloud_controller.h>
+#include <lcloud_filesys.h>
+#include <lcloud_cache.h>
+#include <lcloud_histo.h>
+
+// Defines
+#define LCLOUD_MICROBENCH_ARGUMENTS "hcafn:k:m:C:"
+#define MB_DEFAULT_OPS 200000      // cache operations per scenario
+#define MB_DEFAULT_KEYS 4096       // distinct blocks in the key universe
+#define MB_ZIPF_THETA 0.99         // zipfian skew
+#define MB_CHURN_FILL 90           // allocator churn runs at this % full
+#define USAGE \
+	"USAGE: lcloud_microbench [-h] [-c] [-a] [-f] [-n <ops>] [-k <keys>] [-m <manifest>] [-C <blocks>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -c - run only the cache scenarios\n" \
+	"    -a - run only the allocator scenarios\n" \
+	"    -f - enable the TinyLFU cache admission filter\n" \
+	"    -n - operations per cache scenario (default 200000)\n" \
+	"    -k - distinct blocks in the cache key universe (default 4096)\n" \
+	"    -m - hardware manifest for the allocator scenarios\n" \
+	"         (default cmpsc311-assign3-manifest.txt)\n" \
+	"    -C - allocator scenarios allocate in clusters of <blocks> device blocks\n" \
+	"\n" \
+
+// Key stream types
+typedef enum {
+	MB_UNIFORM    = 0,  // uniformly random keys
+	MB_ZIPFIAN    = 1,  // zipfian (skewed) keys
+	MB_SCAN       = 2,  // sequential scan over all keys
+	MB_LOOP       = 3,  // loop over a working set 1.5x the cache size
+	MB_MAX_STREAM = 4
+} mbstream;
+
+const char *mbstream_labels[MB_MAX_STREAM] = { "uniform", "zipfian", "scan", "loop" };
+
+// Cache sizes (in blocks) to run each stream against
+int mbcachesizes[] = { 16, 64, 256, 1024 };
+
+//
+// Global Data
+uint64_t mbrandstate = 0x9e3779b97f4a7c15ULL;  // fixed seed, reproducible streams
+
+//
+// Functional Prototypes
+
+int runCacheScenario( mbstream stream, int cachesz, uint32_t ops, uint32_t keys );
+int runAllocatorScenarios( char *manifest );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mbrand
+// Description  : Fast deterministic random numbers (xorshift64*)
+//
+// Inputs       : none
+// Outputs      : next random value
+
+static uint64_t mbrand( void ) {
+	mbrandstate ^= mbrandstate >> 12;
+	mbrandstate ^= mbrandstate << 25;
+	mbrandstate ^= mbrandstate >> 27;
+	return( mbrandstate * 0x2545f4914f6cdd1dULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the microbenchmarks
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, cacheonly = 0, alloconly = 0, s, c;
+	uint32_t ops = MB_DEFAULT_OPS, keys = MB_DEFAULT_KEYS;
+	char *manifest = "cmpsc311-assign3-manifest.txt";
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, LCLOUD_MICROBENCH_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'c': // Cache only
+			cacheonly = 1;
+			break;
+
+		case 'a': // Allocator only
+			alloconly = 1;
+			break;
+
+		case 'f': // Cache admission filter
+			lcloud_cacheadmission( 1 );
+			break;
+
+		case 'n': // Operations per scenario
+			ops = atoi( optarg );
+			break;
+
+		case 'k': // Key universe
+			keys = atoi( optarg );
+			break;
+
+		case 'm': // Hardware manifest
+			manifest = optarg;
+			break;
+
+		case 'C': // Allocation cluster size
+			if ( lccluster(atoi(optarg)) ) {
+				fprintf( stderr, "Bad cluster size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	if ( (ops == 0) || (keys == 0) ) {
+		fprintf( stderr, "Bad operation or key count, aborting.\n" );
+		return( -1 );
+	}
+
+	// Setup the log (errors only, the benchmark reports on stdout)
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	LcControllerLLevel = registerLogLevel("LCLOUD_CONTROLLER", 0);
+	LcDriverLLevel = registerLogLevel("LCLOUD_DRIVER", 0);
+	LcSimulatorLLevel = registerLogLevel("LCLOUD_SIMULATOR", 0);
+
+	// Cache scenarios
+	if ( ! alloconly ) {
+		printf( "%-9s %-10s %8s %10s %10s %9s\n", "cache", "stream", "blocks", "ops", "ns/op", "hitratio" );
+		for ( s=0; s<MB_MAX_STREAM; s++ ) {
+			for ( c=0; c<sizeof(mbcachesizes)/sizeof(int); c++ ) {
+				if ( runCacheScenario(s, mbcachesizes[c], ops, keys) ) {
+					return( -1 );
+				}
+			}
+		}
+	}
+
+	// Allocator scenarios
+	if ( ! cacheonly ) {
+		if ( runAllocatorScenarios(manifest) ) {
+			return( -1 );
+		}
+	}
+
+	// Cleanup, return successfully
+	freeLogRegistrations();
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : runCacheScenario
+// Description  : Drive the cache with a key stream, inserting each block that
+//                misses (read-through), and report ns/op and hit ratio
+//
+// Inputs       : stream - the key stream type
+//                cachesz - cache size (blocks)
+//                ops - number of lookups
+//                keys - distinct blocks in the key universe
+// Outputs      : 0 if successful, -1 if failure
+
+int runCacheScenario( mbstream stream, int cachesz, uint32_t ops, uint32_t keys ) {
+
+	// Local variables
+	uint32_t *keystream, i, k, loopsz;
+	double *zipfcdf = NULL, u, norm = 0.0;
+	char block[LC_DEVICE_BLOCK_SIZE];
+	uint64_t start, elapsed, hits = 0;
+	int lo, hi, mid;
+
+	// Build the key stream up front so generation is not timed
+	if ( (keystream = malloc(sizeof(uint32_t) * ops)) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "Failed to allocate key stream" );
+		return( -1 );
+	}
+	if ( stream == MB_ZIPFIAN ) {
+		if ( (zipfcdf = malloc(sizeof(double) * keys)) == NULL ) {
+			free( keystream );
+			return( -1 );
+		}
+		for ( i=0; i<keys; i++ ) {
+			norm += 1.0 / pow( (double)(i+1), MB_ZIPF_THETA );
+			zipfcdf[i] = norm;
+		}
+	}
+	loopsz = cachesz + cachesz/2;
+	for ( i=0; i<ops; i++ ) {
+		switch ( stream ) {
+		case MB_UNIFORM:
+			keystream[i] = mbrand() % keys;
+			break;
+		case MB_ZIPFIAN:
+			u = ((double)(mbrand() >> 11) / (double)(1ULL << 53)) * norm;
+			for ( lo=0, hi=keys-1; lo<hi; ) {
+				mid = (lo + hi) / 2;
+				if ( zipfcdf[mid] < u ) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+			keystream[i] = lo;
+			break;
+		case MB_SCAN:
+			keystream[i] = i % keys;
+			break;
+		default:
+			keystream[i] = i % loopsz;
+			break;
+		}
+	}
+
+	// Run the stream against a fresh cache
+	memset( block, 'x', LC_DEVICE_BLOCK_SIZE );
+	lcloud_initcache( cachesz );
+	start = lchist_now();
+	for ( i=0; i<ops; i++ ) {
+		k = keystream[i];
+		if ( lcloud_getcache(k & 0xf, (k >> 4) & 0xffff, k >> 20) != NULL ) {
+			hits ++;
+		} else {
+			lcloud_putcache( k & 0xf, (k >> 4) & 0xffff, k >> 20, block );
+		}
+	}
+	elapsed = lchist_now() - start;
+	lcloud_closecache();
+
+	printf( "%-9s %-10s %8d %10u %10.1f %9.4f\n", "cache", mbstream_labels[stream], cachesz, ops,
+		(double)elapsed/ops, (double)hits/ops );
+
+	// Cleanup, return successfully
+	free( keystream );
+	free( zipfcdf );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : runAllocatorScenarios
+// Description  : Drive the block allocator on the device metadata: fill all
+//                devices, free everything, then churn (random free + allocate)
+//                at MB_CHURN_FILL percent full
+//
+// Inputs       : manifest - the hardware manifest to power on
+// Outputs      : 0 if successful, -1 if failure
+
+int runAllocatorScenarios( char *manifest ) {
+
+	// Local variables
+	typedef struct { int dev, sec, blk; } mbblock;
+	mbblock *blocks;
+	LcStats stats;
+	LcFHandle fh;
+	uint64_t start, elapsed, total, churn, i, victim;
+
+	// Power on the devices (through the simulated bus) with one file
+	if ( readLionCloudHardwareManifest(manifest) ) {
+		return( -1 );
+	}
+	start = lchist_now();
+	if ( (fh = lcopen("microbench")) == -1 ) {
+		return( -1 );
+	}
+	elapsed = lchist_now() - start;
+	lcstats( &stats );
+	total = stats.totalblocks;
+	if ( (blocks = malloc(sizeof(mbblock) * total)) == NULL ) {
+		return( -1 );
+	}
+
+	printf( "%-9s %-10s %8s %10s %10s\n", "allocator", "pattern", "full%", "ops", "ns/op" );
+	printf( "%-9s %-10s %8d %10d %10.1f\n", "allocator", "poweron", 0, 1, (double)elapsed );
+
+	// Fill every device
+	start = lchist_now();
+	for ( i=0; i<total; i++ ) {
+		if ( lcloud_allocblk(fh, i, &blocks[i].dev, &blocks[i].sec, &blocks[i].blk) ) {
+			logMessage( LOG_ERROR_LEVEL, "Allocator fill failed at %lu of %lu blocks", i, total );
+			return( -1 );
+		}
+	}
+	elapsed = lchist_now() - start;
+	printf( "%-9s %-10s %8d %10lu %10.1f\n", "allocator", "fill", 100, total, (double)elapsed/total );
+
+	// Free everything (in reverse)
+	start = lchist_now();
+	for ( i=total; i>0; i-- ) {
+		lcloud_freeblk( blocks[i-1].dev, blocks[i-1].sec, blocks[i-1].blk );
+	}
+	elapsed = lchist_now() - start;
+	printf( "%-9s %-10s %8d %10lu %10.1f\n", "allocator", "free", 0, total, (double)elapsed/total );
+
+	// Churn: fill to MB_CHURN_FILL percent, then free a random block and allocate a new one
+	churn = total * MB_CHURN_FILL / 100;
+	for ( i=0; i<churn; i++ ) {
+		lcloud_allocblk( fh, i, &blocks[i].dev, &blocks[i].sec, &blocks[i].blk );
+	}
+	start = lchist_now();
+	for ( i=0; i<total; i++ ) {
+		victim = mbrand() % churn;
+		lcloud_freeblk( blocks[victim].dev, blocks[victim].sec, blocks[victim].blk );
+		if ( lcloud_allocblk(fh, victim, &blocks[victim].dev, &blocks[victim].sec, &blocks[victim].blk) ) {
+			logMessage( LOG_ERROR_LEVEL, "Allocator churn failed at %lu", i );
+			return( -1 );
+		}
+	}
+	elapsed = lchist_now() - start;
+	printf( "%-9s %-10s %8d %10lu %10.1f\n", "allocator", "churn", MB_CHURN_FILL, total, (double)elapsed/(2*total) );
+
+	// Return the blocks, power off
+	for ( i=0; i<churn; i++ ) {
+		lcloud_freeblk( blocks[i].dev, blocks[i].sec, blocks[i].blk );
+	}
+	free( blocks );
+	lcclose( fh );
+	lcshutdown();
+	lc_cleanup_controller_system();
+	return( 0 );
+}
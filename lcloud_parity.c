@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_parity.c
+//  Description    : This is the XOR parity kernel for the LionCloud parity
+//                   striped layout: one pass over all the sources, 32 (AVX2),
+//                   16 (SSE2) or 8 bytes at a time, picked once at run time.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <cmpsc311_log.h>
+
+#include <lcloud_parity.h>
+
+// Types
+typedef void (*parity_kernel)(char *dst, const char **srcs, int n, int len);
+
+//
+// Global data
+
+static parity_kernel kernel = NULL;    // picked on first use
+static const char *kernelname = "scalar";
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : parity_scalar
+// Description  : portable kernel, 8 bytes at a time
+
+static void parity_scalar(char *dst, const char **srcs, int n, int len){
+    uint64_t acc, w;
+    int i, s;
+
+    for(i=0; i<len; i+=sizeof(acc)){
+        memcpy(&acc, srcs[0]+i, sizeof(acc));
+        for(s=1; s<n; s++){
+            memcpy(&w, srcs[s]+i, sizeof(w));
+            acc ^= w;
+        }
+        memcpy(dst+i, &acc, sizeof(acc));
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : parity_sse2
+// Description  : SSE2 kernel, 16 bytes at a time (two registers per step)
+
+__attribute__((target("sse2")))
+static void parity_sse2(char *dst, const char **srcs, int n, int len){
+    __m128i a0, a1;
+    int i, s;
+
+    for(i=0; i<len; i+=32){
+        a0 = _mm_loadu_si128((const __m128i *)(srcs[0]+i));
+        a1 = _mm_loadu_si128((const __m128i *)(srcs[0]+i+16));
+        for(s=1; s<n; s++){
+            a0 = _mm_xor_si128(a0, _mm_loadu_si128((const __m128i *)(srcs[s]+i)));
+            a1 = _mm_xor_si128(a1, _mm_loadu_si128((const __m128i *)(srcs[s]+i+16)));
+        }
+        _mm_storeu_si128((__m128i *)(dst+i), a0);
+        _mm_storeu_si128((__m128i *)(dst+i+16), a1);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : parity_avx2
+// Description  : AVX2 kernel, 32 bytes at a time
+
+__attribute__((target("avx2")))
+static void parity_avx2(char *dst, const char **srcs, int n, int len){
+    __m256i acc;
+    int i, s;
+
+    for(i=0; i<len; i+=32){
+        acc = _mm256_loadu_si256((const __m256i *)(srcs[0]+i));
+        for(s=1; s<n; s++){
+            acc = _mm256_xor_si256(acc, _mm256_loadu_si256((const __m256i *)(srcs[s]+i)));
+        }
+        _mm256_storeu_si256((__m256i *)(dst+i), acc);
+    }
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : parity_pick
+// Description  : choose the widest kernel the CPU supports
+
+static void parity_pick(void){
+    kernel = parity_scalar;
+    kernelname = "scalar";
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        kernel = parity_avx2;
+        kernelname = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse2")){
+        kernel = parity_sse2;
+        kernelname = "sse2";
+    }
+#endif
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcparity_xor
+// Description  : XOR blocks together (parity, or reconstructing a block from
+//                the parity and the rest of its stripe row)
+//
+// Inputs       : dst - the result (may be one of the sources)
+//                srcs/n - the blocks (1 to LC_PARITY_MAXSOURCES)
+//                len - bytes, a multiple of 32
+// Outputs      : 0 if successful, -1 if failure
+
+int lcparity_xor( char *dst, const char **srcs, int n, int len ) {
+
+    if(n < 1 || n > LC_PARITY_MAXSOURCES || len % 32 != 0){
+        logMessage(LOG_ERROR_LEVEL, "Bad parity XOR of %d blocks of %d bytes", n, len);
+        return( -1 );
+    }
+    if(kernel == NULL){
+        parity_pick();
+    }
+    kernel(dst, srcs, n, len);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcparity_kernel
+// Description  : Name of the XOR kernel in use
+//
+// Inputs       : none
+// Outputs      : avx2, sse2 or scalar
+
+const char *lcparity_kernel( void ) {
+    if(kernel == NULL){
+        parity_pick();
+    }
+    return( kernelname );
+}
@@ -0,0 +1,29 @@
+#ifndef LCLOUD_PARITY_INCLUDED
+#define LCLOUD_PARITY_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_parity.h
+//  Description    : This is the XOR parity kernel for the LionCloud parity
+//                   striped layout (vectorized where the CPU allows it).
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define LC_PARITY_MAXSOURCES 16    // most blocks XORed in one call
+
+//
+// Functional Prototypes
+
+int lcparity_xor( char *dst, const char **srcs, int n, int len );
+    // dst = srcs[0] ^ srcs[1] ^ ... ^ srcs[n-1] over len bytes (len a multiple of 32)
+
+const char *lcparity_kernel( void );
+    // Name of the XOR kernel in use (avx2, sse2 or scalar)
+
+#endif
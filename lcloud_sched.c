@@ -0,0 +1,528 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_sched.c
+//  Description    : This is the per-device I/O scheduler for the LionCloud
+//                   filesystem.  Each device has a small queue of pending
+//                   block transfers; a read of a block already queued is
+//                   merged into that request, a write to a block with a
+//                   write queued replaces it, and reads of a block with a
+//                   write queued are answered from the write.  Queues are
+//                   dispatched (in policy order) at read sync points, when
+//                   full, when a request exceeds the max queue latency, and
+//                   on close/shutdown.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmpsc311_log.h>
+#include <lcloud_sched.h>
+#include <lcloud_histo.h>
+
+// a read merged into a queued request
+typedef struct {
+    char *dest;          // where the bytes go
+    int   off;           // offset in the block
+    int   len;           // number of bytes
+    int  *err;           // set to -1 if the read fails (NULL - not wanted)
+}schedwaiter;
+
+// a queued block transfer
+typedef struct {
+    int         used;
+    int         dir;         // LC_XFER_READ/LC_XFER_WRITE
+    int         sec;
+    int         blk;
+    uint64_t    seq;         // arrival order
+    uint64_t    queued;      // arrival time (ns)
+    int         nwaiters;    // reads only
+    schedwaiter waiters[LC_SCHED_MAXWAITERS];
+    char        data[LC_DEVICE_BLOCK_SIZE];
+}schedreq;
+
+// a device queue
+typedef struct {
+    schedreq reqs[LC_SCHED_MAXQUEUE];
+    int      depth;          // requests queued
+    uint64_t oldest;         // arrival time of the oldest request (ns)
+    uint32_t head;           // (sec,blk) position of the last dispatch
+}schedqueue;
+
+const char *LC_SCHED_POLICY_LABELS[LC_SCHED_MAXPOLICY] = { "fifo", "deadline", "elevator" };
+
+static LcSchedPolicy schedpolicy = LC_SCHED_DEADLINE;
+static uint64_t schedmaxlatency = LC_SCHED_MAXLATENCY;
+static LcSchedXfer schedxfer = NULL;
+static schedqueue *queues = NULL;      // indexed by device id
+static uint64_t schedseq = 0;
+static LcSchedStats schedstats;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sched_key
+// Description  : elevator position of a request, (sec,blk) order
+//
+// Inputs       : req - the request
+// Outputs      : position
+
+static uint32_t sched_key(schedreq *req){
+    return ((uint32_t)req->sec << 16) | (uint32_t)req->blk;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sched_before
+// Description  : policy order of two requests
+//
+// Inputs       : q - the device queue
+//                a, b - the requests
+//                now - current time (ns)
+// Outputs      : true if a is dispatched before b
+
+static int sched_before(schedqueue *q, schedreq *a, schedreq *b, uint64_t now){
+    int expa, expb, wrapa, wrapb;
+
+    if(schedpolicy == LC_SCHED_FIFO){
+        return a->seq < b->seq;
+    }
+    if(schedpolicy == LC_SCHED_DEADLINE){
+        expa = (now - a->queued) > schedmaxlatency;
+        expb = (now - b->queued) > schedmaxlatency;
+        if(expa || expb){
+            return (expa != expb) ? expa : (a->seq < b->seq);
+        }
+    }
+
+    // one-way sweep from the last position, wrapping around to the start
+    wrapa = sched_key(a) < q->head;
+    wrapb = sched_key(b) < q->head;
+    if(wrapa != wrapb){
+        return wrapb;
+    }
+    return sched_key(a) < sched_key(b);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sched_find
+// Description  : find a queued request for a block
+//
+// Inputs       : q - the device queue
+//                dir - the transfer direction
+//                sec, blk - the block
+// Outputs      : the request, NULL if none
+
+static schedreq *sched_find(schedqueue *q, int dir, int sec, int blk){
+    int i, seen;
+
+    for(i=0, seen=0; i<LC_SCHED_MAXQUEUE && seen<q->depth; i++){
+        if(q->reqs[i].used){
+            seen++;
+            if(q->reqs[i].dir == dir && q->reqs[i].sec == sec && q->reqs[i].blk == blk){
+                return &q->reqs[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sched_dispatch
+// Description  : send the requests of a device queue to the device in policy
+//                order (all of them, or only the reads and expired requests).
+//                A write that fails stays queued (to go out again at the
+//                next dispatch), the waiters of a read that fails are told
+//                through their err.
+//
+// Inputs       : did - the device
+//                all - dispatch everything
+// Outputs      : 0 if successful, -1 if any transfer failed
+
+static int sched_dispatch(LcDeviceId did, int all){
+    schedqueue *q = &queues[did];
+    schedreq *req;
+    int order[LC_SCHED_MAXQUEUE], n = 0, i, j, tmp, ret = 0;
+    uint64_t now = lchist_now(), maxseq = 0;
+
+    // pick the requests, insertion sort them into policy order
+    for(i=0; i<LC_SCHED_MAXQUEUE; i++){
+        req = &q->reqs[i];
+        if(!req->used || !(all || req->dir == LC_XFER_READ || (now - req->queued) > schedmaxlatency)){
+            continue;
+        }
+        order[n] = i;
+        for(j=n++; j>0 && sched_before(q, &q->reqs[order[j]], &q->reqs[order[j-1]], now); j--){
+            tmp = order[j];
+            order[j] = order[j-1];
+            order[j-1] = tmp;
+        }
+    }
+
+    // issue them
+    for(i=0; i<n; i++){
+        req = &q->reqs[order[i]];
+        if(schedxfer(req->dir, did, req->sec, req->blk, req->data)){
+            ret = -1;
+            if(req->dir == LC_XFER_WRITE){
+                schedstats.retried++;
+                continue;
+            }
+            for(j=0; j<req->nwaiters; j++){
+                if(req->waiters[j].err != NULL){
+                    *req->waiters[j].err = -1;
+                }
+            }
+        }
+        else if(req->dir == LC_XFER_READ){
+            for(j=0; j<req->nwaiters; j++){
+                memcpy(req->waiters[j].dest, &req->data[req->waiters[j].off], req->waiters[j].len);
+            }
+        }
+        if(req->seq < maxseq){
+            schedstats.reorders++;
+        }
+        else{
+            maxseq = req->seq;
+        }
+        q->head = sched_key(req);
+        req->used = 0;
+        q->depth--;
+        schedstats.dispatched++;
+    }
+
+    // the oldest of whatever is left
+    q->oldest = UINT64_MAX;
+    for(i=0; i<LC_SCHED_MAXQUEUE; i++){
+        if(q->reqs[i].used && q->reqs[i].queued < q->oldest){
+            q->oldest = q->reqs[i].queued;
+        }
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sched_expire
+// Description  : dispatch the queues holding a request older than the max latency
+//
+// Outputs      : 0 if successful, -1 if failure
+
+static int sched_expire(void){
+    uint64_t now = lchist_now();
+    int did, ret = 0;
+
+    for(did=0; did<LC_SCHED_MAXDEVICES; did++){
+        if(queues[did].depth > 0 && (now - queues[did].oldest) > schedmaxlatency){
+            schedstats.expired++;
+            if(sched_dispatch(did, 1)){
+                ret = -1;
+            }
+        }
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sched_add
+// Description  : take a free slot in a device queue (dispatching it if full)
+//
+// Inputs       : did - the device
+//                dir, sec, blk - the transfer
+// Outputs      : the new request, NULL if failure (the queue is full of
+//                writes failing)
+
+static schedreq *sched_add(LcDeviceId did, int dir, int sec, int blk){
+    schedqueue *q = &queues[did];
+    schedreq *req;
+    int i;
+
+    if(q->depth == LC_SCHED_MAXQUEUE){
+        sched_dispatch(did, 1);
+        if(q->depth == LC_SCHED_MAXQUEUE){
+            logMessage(LOG_ERROR_LEVEL, "I/O scheduler queue of device [%d] is full of failed writes", did);
+            return NULL;
+        }
+    }
+    for(i=0; q->reqs[i].used; i++);
+    req = &q->reqs[i];
+    req->used = 1;
+    req->dir = dir;
+    req->sec = sec;
+    req->blk = blk;
+    req->seq = schedseq++;
+    req->queued = lchist_now();
+    req->nwaiters = 0;
+    if(q->depth++ == 0){
+        q->oldest = req->queued;
+    }
+    if(q->depth > schedstats.maxdepth){
+        schedstats.maxdepth = q->depth;
+    }
+    schedstats.queued++;
+    return req;
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_setpolicy
+// Description  : Select the dispatch policy and max queue latency (takes
+//                effect at the next lcsched_init, i.e. power on)
+//
+// Inputs       : policy - the dispatch policy
+//                maxlatency - max time a request may stay queued (ns)
+// Outputs      : 0 if successful, -1 if failure
+
+int lcsched_setpolicy( LcSchedPolicy policy, uint64_t maxlatency ) {
+    if(policy >= LC_SCHED_MAXPOLICY){
+        logMessage(LOG_ERROR_LEVEL, "Unknown I/O scheduler policy [%d]", policy);
+        return( -1 );
+    }
+    schedpolicy = policy;
+    schedmaxlatency = maxlatency;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_init
+// Description  : Set up the (empty) device queues
+//
+// Inputs       : xfer - the function the queues are dispatched through
+// Outputs      : 0 if successful, -1 if failure
+
+int lcsched_init( LcSchedXfer xfer ) {
+    int did;
+
+    if(queues == NULL && (queues = (schedqueue *)calloc(LC_SCHED_MAXDEVICES, sizeof(schedqueue))) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Failed to allocate I/O scheduler queues");
+        return( -1 );
+    }
+    for(did=0; did<LC_SCHED_MAXDEVICES; did++){
+        memset(&queues[did], 0x0, sizeof(schedqueue));
+        queues[did].oldest = UINT64_MAX;
+    }
+    schedxfer = xfer;
+    schedseq = 0;
+    memset(&schedstats, 0x0, sizeof(schedstats));
+    schedstats.policy = schedpolicy;
+
+    logMessage(LcDriverLLevel, "I/O scheduler initialized (%s, max latency %lu ns)",
+        LC_SCHED_POLICY_LABELS[schedpolicy], schedmaxlatency);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_read
+// Description  : Queue a read of part of a block (merging it with a queued
+//                read of the same block, or answering it from a queued write)
+//
+// Inputs       : did, sec, blk - the block
+//                dest - where the bytes go (valid until the queue is
+//                       dispatched, or the read is cancelled)
+//                off, len - the part of the block wanted
+//                err - set to -1 if the read fails when dispatched (or NULL)
+// Outputs      : 1 if satisfied from a queued write, 0 if queued, -1 if failure
+
+int lcsched_read( LcDeviceId did, int sec, int blk, char *dest, int off, int len, int *err ) {
+    schedreq *req;
+
+    if(queues == NULL || did >= LC_SCHED_MAXDEVICES){
+        logMessage(LOG_ERROR_LEVEL, "I/O scheduler read for bad device [%d]", did);
+        return( -1 );
+    }
+
+    // the newest data for the block is in a queued write
+    if((req = sched_find(&queues[did], LC_XFER_WRITE, sec, blk)) != NULL){
+        memcpy(dest, &req->data[off], len);
+        schedstats.forwarded++;
+        return( 1 );
+    }
+
+    // join a queued read of the block, or queue a new one
+    if((req = sched_find(&queues[did], LC_XFER_READ, sec, blk)) != NULL &&
+            req->nwaiters < LC_SCHED_MAXWAITERS){
+        schedstats.merges++;
+    }
+    else if((req = sched_add(did, LC_XFER_READ, sec, blk)) == NULL){
+        return( -1 );
+    }
+    req->waiters[req->nwaiters].dest = dest;
+    req->waiters[req->nwaiters].off = off;
+    req->waiters[req->nwaiters].len = len;
+    req->waiters[req->nwaiters].err = err;
+    req->nwaiters++;
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_cancel
+// Description  : Drop the queued reads into dest..dest+len (a caller giving
+//                up before the queues run); a read left with no waiters is
+//                not sent
+//
+// Inputs       : dest - start of the caller's buffer
+//                len - its length
+// Outputs      : number of waiters dropped
+
+int lcsched_cancel( const char *dest, size_t len ) {
+    schedqueue *q;
+    schedreq *req;
+    int did, i, j, k, n = 0;
+
+    for(did=0; queues != NULL && did<LC_SCHED_MAXDEVICES; did++){
+        q = &queues[did];
+        for(i=0; i<LC_SCHED_MAXQUEUE && q->depth > 0; i++){
+            req = &q->reqs[i];
+            if(!req->used || req->dir != LC_XFER_READ){
+                continue;
+            }
+            for(j=0, k=0; j<req->nwaiters; j++){
+                if(req->waiters[j].dest >= dest && req->waiters[j].dest < dest + len){
+                    n++;
+                    continue;
+                }
+                req->waiters[k++] = req->waiters[j];
+            }
+            if((req->nwaiters = k) == 0){
+                req->used = 0;
+                q->depth--;
+            }
+        }
+    }
+    return( n );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_write
+// Description  : Queue a write of a block (replacing a queued write of it)
+//
+// Inputs       : did, sec, blk - the block
+//                data - the block contents (copied)
+// Outputs      : 0 if successful, -1 if failure
+
+int lcsched_write( LcDeviceId did, int sec, int blk, const char *data ) {
+    schedreq *req;
+
+    if(queues == NULL || did >= LC_SCHED_MAXDEVICES){
+        logMessage(LOG_ERROR_LEVEL, "I/O scheduler write for bad device [%d]", did);
+        return( -1 );
+    }
+
+    if((req = sched_find(&queues[did], LC_XFER_WRITE, sec, blk)) != NULL){
+        schedstats.superseded++;
+    }
+    else{
+        // a read queued earlier must see the old contents (it is sent, or
+        // failed and its waiters told, either way it leaves the queue)
+        if(sched_find(&queues[did], LC_XFER_READ, sec, blk) != NULL){
+            sched_dispatch(did, 1);
+        }
+        if((req = sched_add(did, LC_XFER_WRITE, sec, blk)) == NULL){
+            return( -1 );
+        }
+    }
+    memcpy(req->data, data, LC_DEVICE_BLOCK_SIZE);
+
+    // (expired writes that fail stay queued, they are not this write's error)
+    sched_expire();
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_run
+// Description  : Dispatch the device queues.  At a read sync point (all = 0)
+//                the deadline policy only sends the reads and the expired
+//                writes, letting the other writes keep coalescing; the
+//                other policies send everything.  Writes that fail stay
+//                queued; readers learn of their own failed reads through
+//                the err given to lcsched_read.
+//
+// Inputs       : all - dispatch every queued request
+// Outputs      : 0 if successful, -1 if any transfer failed
+
+int lcsched_run( int all ) {
+    int did, ret = 0;
+
+    if(queues == NULL){
+        return( 0 );
+    }
+    if(schedpolicy != LC_SCHED_DEADLINE){
+        all = 1;
+    }
+    for(did=0; did<LC_SCHED_MAXDEVICES; did++){
+        if(queues[did].depth > 0 && sched_dispatch(did, all)){
+            ret = -1;
+        }
+    }
+    if(sched_expire()){
+        ret = -1;
+    }
+    return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_close
+// Description  : Dispatch everything and release the queues (writes still
+//                failing are given up)
+//
+// Outputs      : 0 if successful, -1 if failure
+
+int lcsched_close( void ) {
+    int did, ret;
+
+    ret = lcsched_run(1);
+    for(did=0; queues != NULL && did<LC_SCHED_MAXDEVICES; did++){
+        if(queues[did].depth > 0){
+            logMessage(LOG_ERROR_LEVEL, "Dropping %d failed writes queued for device [%d]", queues[did].depth, did);
+        }
+    }
+    free(queues);
+    queues = NULL;
+    return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_depth
+// Description  : Get the number of requests queued for a device
+//
+// Inputs       : did - the device
+// Outputs      : queued requests, 0 if the device is unknown
+
+int lcsched_depth( LcDeviceId did ) {
+    if(queues == NULL || did >= LC_SCHED_MAXDEVICES){
+        return( 0 );
+    }
+    return( queues[did].depth );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lcsched_stats
+// Description  : Get the scheduler counters
+//
+// Inputs       : stats - structure to fill with the counters
+// Outputs      : 0 if successful, -1 if failure
+
+int lcsched_stats( LcSchedStats *stats ) {
+    if(stats == NULL){
+        return( -1 );
+    }
+    memcpy(stats, &schedstats, sizeof(LcSchedStats));
+    return( 0 );
+}
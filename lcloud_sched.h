@@ -0,0 +1,73 @@
+#ifndef LCLOUD_SCHED_INCLUDED
+#define LCLOUD_SCHED_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_sched.h
+//  Description    : This is the per-device I/O scheduler API for the LionCloud
+//                   filesystem.  Block transfers are queued per device,
+//                   duplicate reads are merged, superseded writes dropped,
+//                   and the queues are dispatched in policy order.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdint.h>
+#include <lcloud_controller.h>
+#include <lcloud_filesys.h>
+
+// Defines
+#define LC_SCHED_MAXDEVICES 16         // device ids are 0-15 (probe bitmask)
+#define LC_SCHED_MAXQUEUE 64           // requests queued per device before it is dispatched
+#define LC_SCHED_MAXWAITERS 4          // reads merged into one queued read
+#define LC_SCHED_MAXLATENCY 1000000    // default max time a request may stay queued (ns)
+
+// Dispatch policies
+typedef enum {
+    LC_SCHED_FIFO      = 0,   // arrival order, everything dispatched at each sync point
+    LC_SCHED_DEADLINE  = 1,   // sync points dispatch reads (and expired writes) only,
+                              // expired requests first, then by (sec,blk)
+    LC_SCHED_ELEVATOR  = 2,   // one-way sweep by (sec,blk) from the last position
+    LC_SCHED_MAXPOLICY = 3
+} LcSchedPolicy;
+extern const char *LC_SCHED_POLICY_LABELS[LC_SCHED_MAXPOLICY];
+
+// Transfer function the queues are dispatched through (LC_XFER_READ/WRITE)
+typedef int (*LcSchedXfer)( int dir, LcDeviceId did, int sec, int blk, char *buf );
+
+//
+// Functional Prototypes
+
+int lcsched_setpolicy( LcSchedPolicy policy, uint64_t maxlatency );
+    // Select the dispatch policy and max queue latency (used from the next init)
+
+int lcsched_init( LcSchedXfer xfer );
+    // Set up the (empty) device queues
+
+int lcsched_read( LcDeviceId did, int sec, int blk, char *dest, int off, int len, int *err );
+    // Queue a read of bytes off..off+len of a block into dest (1 if it was
+    // satisfied immediately from a queued write, 0 if queued, -1 if failure);
+    // *err is set to -1 if the read fails when dispatched
+
+int lcsched_cancel( const char *dest, size_t len );
+    // Drop the queued reads into dest..dest+len
+
+int lcsched_write( LcDeviceId did, int sec, int blk, const char *data );
+    // Queue a write of a block (the data is copied; a write that fails stays
+    // queued and is sent again at the next dispatch)
+
+int lcsched_run( int all );
+    // Dispatch the queues: all requests, or those needed at a read sync point
+
+int lcsched_depth( LcDeviceId did );
+    // Get the number of requests queued for a device
+
+int lcsched_close( void );
+    // Dispatch everything and release the queues
+
+int lcsched_stats( LcSchedStats *stats );
+    // Get the scheduler counters
+
+#endif
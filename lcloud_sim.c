@@ -17,6 +17,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 #include <cmpsc311_assocarr.h>
@@ -25,16 +26,45 @@
 // Project Includes
 #include <lcloud_controller.h>
 #include <lcloud_filesys.h>
+#include <lcloud_histo.h>
+#include <lcloud_trace.h>
+#include <lcloud_sched.h>
+#include <lcloud_cache.h>
+#include <lcloud_dedup.h>
+#include <lcloud_parity.h>
 
 // Defines
-#define LCLOUD_ARGUMENTS "huvl:x:"
+#define LCLOUD_ARGUMENTS "huvtADHzTl:x:s:r:q:w:L:Z:d:p:m:P:C:I:b:"
 #define USAGE \
-	"USAGE: lcloud_sim [-h] [-v] [-l <logfile>] <hardware-manifest> <workload-file>\n" \
+	"USAGE: lcloud_sim [-h] [-v] [-t] [-A] [-D] [-H] [-z] [-T] [-l <logfile>] [-s <statsfile>] [-q <policy>] [-p <policy>] [-w <snapshot>] [-L <l2file>] [-Z <bytes>] [-d <ops>] [-m <copies>] [-P <width>:<unit>] [-C <blocks>] [-I <bytes>] [-b <ops>] <hardware-manifest> <workload-file>\n" \
+	"       lcloud_sim [-v] -r <tracefile> <workload-file>\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
 	"    -v - verbose output\n" \
+	"    -t - the workload file is a binary trace (see -r), replay it\n" \
 	"    -l - write log messages to the filename <logfile>\n" \
+	"    -s - write performance counters (JSON) to <statsfile> at exit and on SIGUSR1\n" \
+	"    -A - enable the TinyLFU cache admission filter\n" \
+	"    -D - deduplicate blocks with identical contents\n" \
+	"    -H - back the cache payloads with huge pages\n" \
+	"    -z - store blocks written as all zeros as holes\n" \
+	"    -T - pack the partial last blocks of closed files into shared blocks\n" \
+	"    -q - I/O scheduler policy: fifo, deadline (default) or elevator\n" \
+	"    -p - device placement policy: fill (default) or weighted (by free blocks\n" \
+	"         and queue depth)\n" \
+	"    -w - warm restart: save the cached block set to <snapshot> at shutdown and\n" \
+	"         prefetch the blocks of it that files hold at power on\n" \
+	"    -L - add an L2 victim cache of evicted blocks in the mapped host file <l2file>\n" \
+	"    -Z - keep evicted blocks LZ compressed in a tier of <bytes> bytes\n" \
+	"    -d - defragment the files every <ops> workload operations (0 - only at the end)\n" \
+	"    -m - mirror every file: keep <copies> copies of each block on distinct devices\n" \
+	"    -P - stripe every file over <width> units of <unit> blocks with rotating\n" \
+	"         XOR parity (width + 1 devices hold each stripe)\n" \
+	"    -C - allocate and read in file blocks in clusters of <blocks> device blocks\n" \
+	"    -I - keep files of up to <bytes> bytes inline in their file record\n" \
+	"    -b - replay the trace (-t) in batches of up to <ops> operations (lcsubmit)\n" \
+	"    -r - record the workload into the binary trace <tracefile> (no simulation)\n" \
 	"\n" \
 	"    <hardware-manifest> - file containing the simulated hardware definitions" \
 	"    <workload-file> - file contain the workload to simulate\n" \
@@ -43,11 +73,37 @@
 //
 // Global Data
 int verbose;
+char *statsfile = NULL;                // Performance counter output file
+volatile sig_atomic_t statsrequested;  // Set by SIGUSR1 to dump counters
+int defraginterval = -1;               // Operations between lcdefrag passes (-1 off, 0 at the end)
+int filecopies = 1;                    // Copies kept of each file block (lcreplicate)
+int paritywidth = 0, parityunit = 0;   // Parity stripe of every file (lcparity, unit 0 off)
+int batchops = 0;                      // Trace operations submitted together (lcsubmit, 0 - one call each)
+LcFragReport fragbefore, fragafter;    // Fragmentation before the first and after the last pass
+
+/* Workload progress (reported with the performance counters) */
+typedef struct {
+	int      completed;   // the workload ran to the end
+	int      failed;      // the workload was aborted
+	uint64_t operations;  // workload operations processed
+	uint64_t bytes;       // bytes read and written by the workload
+	uint64_t started;     // time the workload started (ns)
+	uint64_t elapsed;     // time spent processing the workload (ns)
+	int      opens, reads, writes, seeks, closes;
+} simprogress;
+simprogress wlprogress;
 
 //
 // Functional Prototypes
 
 int simulateLionCloud( char *hwdef, char *wload ); // LionCloud simulation
+int simulateLionCloudTrace( char *hwdef, char *tracefile ); // LionCloud trace replay
+int dumpLionCloudStats( const char *fname );       // Write counters as JSON
+void writeJsonString( FILE *fhandle, const char *str ); // Quoted, escaped JSON string
+int reportLionCloudLatency( void );                // Log the latency percentiles
+void statsSignalHandler( int sig );                // SIGUSR1 handler
+int defragLionCloud( int final );                  // Periodic/final defragmentation pass
+int submitTraceBatch( LcTrace *trace, LcSubmission *sq, const uint32_t *sqop, int *sqres, int nsq ); // Batched replay
 
 //
 // Functions
@@ -64,7 +120,8 @@ int simulateLionCloud( char *hwdef, char *wload ); // LionCloud simulation
 int main( int argc, char *argv[] ) {
 
 	// Local variables
-	int ch, verbose = 0, log_initialized = 0, unit_tests = 0;
+	int ch, verbose = 0, log_initialized = 0, unit_tests = 0, replay = 0, ret, i;
+	char *tracefile = NULL;
 	
 	// Process the command line parameters
 	while ((ch = getopt(argc, argv, LCLOUD_ARGUMENTS)) != -1) {
@@ -82,11 +139,125 @@ int main( int argc, char *argv[] ) {
 			unit_tests = 1;
 			break;
 
+		case 'z': // Zero blocks become holes
+			lczeroholes( 1 );
+			break;
+
+		case 'T': // Pack the tails of small files
+			lctailpack( 1 );
+			break;
+
 		case 'l': // Set the log filename
 			initializeLogWithFilename( optarg );
 			log_initialized = 1;
 			break;
 
+		case 's': // Set the stats filename
+			statsfile = optarg;
+			break;
+
+		case 't': // Replay a binary trace
+			replay = 1;
+			break;
+
+		case 'r': // Record a binary trace
+			tracefile = optarg;
+			break;
+
+		case 'A': // Cache admission filter
+			lcloud_cacheadmission( 1 );
+			break;
+
+		case 'D': // Block deduplication
+			lcdedup_enable( 1 );
+			break;
+
+		case 'H': // Cache huge pages
+			lcloud_cachehugepages( 1 );
+			break;
+
+		case 'w': // Cache warm restart snapshot
+			lcloud_cachesnapshot( optarg );
+			break;
+
+		case 'L': // L2 victim cache file
+			lcloud_cachel2( optarg, LC_CACHE_L2BLOCKS );
+			break;
+
+		case 'Z': // Compressed cache tier
+			if ( lcloud_cachecompress(atoi(optarg)) ) {
+				fprintf( stderr, "Bad compressed tier size [%s]\n", optarg );
+				fprintf( stderr, USAGE );
+				return( -1 );
+			}
+			break;
+
+		case 'b': // Batched trace replay
+			if ( ((batchops = atoi(optarg)) < 2) || (batchops > LC_RING_ENTRIES) ) {
+				fprintf( stderr, "Bad batch size [%s], 2 to %d operations\n", optarg, LC_RING_ENTRIES );
+				fprintf( stderr, USAGE );
+				return( -1 );
+			}
+			break;
+
+		case 'd': // Online defragmentation
+			if ( (defraginterval = atoi(optarg)) < 0 ) {
+				fprintf( stderr, "Bad defragmentation interval [%s]\n", optarg );
+				fprintf( stderr, USAGE );
+				return( -1 );
+			}
+			break;
+
+		case 'm': // Mirrored files
+			if ( ((filecopies = atoi(optarg)) < 1) || (filecopies > LC_MAX_COPIES) ) {
+				fprintf( stderr, "Bad number of copies [%s], 1 to %d\n", optarg, LC_MAX_COPIES );
+				fprintf( stderr, USAGE );
+				return( -1 );
+			}
+			break;
+
+		case 'P': // Parity-striped files
+			if ( (sscanf(optarg, "%d:%d", &paritywidth, &parityunit) != 2) || (paritywidth < 2) ||
+					(paritywidth > LC_PARITY_MAXWIDTH) || (parityunit < 1) || (parityunit > LC_PARITY_MAXUNIT) ) {
+				fprintf( stderr, "Bad parity stripe [%s], 2 to %d units of 1 to %d blocks\n", optarg,
+					LC_PARITY_MAXWIDTH, LC_PARITY_MAXUNIT );
+				fprintf( stderr, USAGE );
+				return( -1 );
+			}
+			break;
+
+		case 'q': // I/O scheduler policy
+			for ( i=0; (i<LC_SCHED_MAXPOLICY) && (strcmp(optarg, LC_SCHED_POLICY_LABELS[i]) != 0); i++ );
+			if ( lcsched_setpolicy(i, LC_SCHED_MAXLATENCY) ) {
+				fprintf( stderr, "Unknown I/O scheduler policy (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'C': // Allocation cluster size
+			if ( lccluster(atoi(optarg)) ) {
+				fprintf( stderr, "Bad cluster size [%s], 1 to %d blocks\n", optarg, LC_CLUSTER_MAXBLOCKS );
+				fprintf( stderr, USAGE );
+				return( -1 );
+			}
+			break;
+
+		case 'I': // Inline tiny files
+			if ( lcinline(atoi(optarg)) ) {
+				fprintf( stderr, "Bad inline file threshold [%s], 0 to %d bytes\n", optarg, LC_INLINE_MAXBYTES );
+				fprintf( stderr, USAGE );
+				return( -1 );
+			}
+			break;
+
+		case 'p': // Device placement policy
+			for ( i=0; (i<LC_PLACE_MAXPOLICY) && (strcmp(optarg, LC_PLACE_POLICY_LABELS[i]) != 0); i++ );
+			if ( lcplacement(i) ) {
+				fprintf( stderr, "Unknown device placement policy (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
 		default:  // Default (unknown)
 			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
 			return( -1 );
@@ -105,6 +276,11 @@ int main( int argc, char *argv[] ) {
 		enableLogLevels(LcControllerLLevel | LcDriverLLevel | LcSimulatorLLevel);
 	}
 
+	// Dump the performance counters on request
+	if ( statsfile != NULL ) {
+		signal( SIGUSR1, statsSignalHandler );
+	}
+
 	// If exgtracting file from data
 	if (unit_tests) {
 
@@ -117,6 +293,18 @@ int main( int argc, char *argv[] ) {
 			logMessage(LOG_ERROR_LEVEL, "Unit tests failed, aborting.\n\n");
 		}
 
+	} else if (tracefile != NULL) {
+
+		// Record the workload (the only remaining parameter) as a trace
+		if ( argv[optind] == NULL ) {
+			fprintf( stderr, "Missing workload file, use -h to see usage, aborting.\n" );
+			return( -1 );
+		}
+		if ( lctrace_record(argv[optind], tracefile) ) {
+			logMessage( LOG_ERROR_LEVEL, "Failed recording trace [%s] from [%s].\n\n", tracefile, argv[optind] );
+			return( -1 );
+		}
+
 	} else {
 
 		// The filename should be the next option
@@ -129,10 +317,21 @@ int main( int argc, char *argv[] ) {
 		}
 
 		// Run the simulation
-		if ( simulateLionCloud(argv[optind], argv[optind+1]) == 0 ) {
+		if ( replay ) {
+			ret = simulateLionCloudTrace( argv[optind], argv[optind+1] );
+		} else {
+			ret = simulateLionCloud( argv[optind], argv[optind+1] );
+		}
+		if ( ret == 0 ) {
 			logMessage( LOG_INFO_LEVEL, "LionCloud simulation completed successfully!!!\n\n" );
 		} else {
 			logMessage( LOG_INFO_LEVEL, "LionCloud simulation failed.\n\n" );
+			wlprogress.failed = 1;
+		}
+
+		// Write out the final performance counters
+		if ( statsfile != NULL ) {
+			dumpLionCloudStats( statsfile );
 		}
 	}
 
@@ -168,7 +367,6 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 	LcFHandle fh;
 	AssocArray fhTable;
 	char buf[LC_MAX_OPERATION_SIZE];
-	int opens, reads, writes, seeks, closes;
 	fsysdata *fdata;
 
 	/* Load the hardware manifest and initalize the local data and simulation */
@@ -185,6 +383,8 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 
 	/* Loop until we are done with the workload */
 	logMessage( LcSimulatorLLevel, "CMPSC311 lcloud : executing workload [%s]", state.filename );
+	memset( &wlprogress, 0x0, sizeof(wlprogress) );
+	wlprogress.started = lchist_now();
 	do {
 
 		/* Get the next operation to process */
@@ -212,6 +412,14 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error opening file [%s], aborting", operation.objname );
 					return( -1 );
 				}
+				if ( (filecopies > 1) && lcreplicate(fh, filecopies) ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error mirroring file [%s], aborting", operation.objname );
+					return( -1 );
+				}
+				if ( (parityunit > 0) && lcparity(fh, paritywidth, parityunit) ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error striping file [%s], aborting", operation.objname );
+					return( -1 );
+				}
 
 				/* Setup the structure */
 				fdata = malloc( sizeof(fsysdata) );
@@ -222,7 +430,7 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 				/* Insert the file into the table */
 				insert_assoc( &fhTable, fdata->filename, fdata );
 				logMessage( LcSimulatorLLevel, "Open file [%s]", fdata->filename );
-				opens ++;
+				wlprogress.opens ++;
 				break;
 
 			case WL_READ: /* Read a block of data from the file */
@@ -242,7 +450,7 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 						return( -1 );
 					}
 					fdata->pos = operation.pos;
-					seeks ++;
+					wlprogress.seeks ++;
 				}
 
 				/* Now do the read from the file */
@@ -264,7 +472,7 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 				fdata->pos += operation.size;
 				logMessage( LcControllerLLevel, "Correctly read from [%s], %d bytes at position %d", 
 					fdata->filename, operation.size, operation.pos );
-				reads ++;
+				wlprogress.reads ++;
 				break;
 
 			case WL_WRITE: /* Write a block of data to the file */
@@ -284,7 +492,7 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 						return( -1 );
 					}
 					fdata->pos = operation.pos;
-					seeks ++;
+					wlprogress.seeks ++;
 				}
 
 				/* Now do the write to the file */
@@ -298,7 +506,7 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 				fdata->pos += operation.size;
 				logMessage( LcControllerLLevel, "Wrote data to file [%s], %d bytes at position %d", 
 					fdata->filename, operation.size, operation.pos );
-				writes ++;
+				wlprogress.writes ++;
 				break;
 
 			case WL_CLOSE:
@@ -322,14 +530,23 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 				delete_assoc( &fhTable, fdata->filename );
 				free( fdata->filename );
 				free( fdata );
-				closes ++;
+				wlprogress.closes ++;
 				break;
 
 			case WL_EOF: // End of the workload file
 				if ( check_honors_option() == 0 ) {
 					logMessage( LOG_INFO_LEVEL, "CMPSC311 - Honors options passed!" );
 				}
-				lcshutdown();
+				if ( defragLionCloud(1) ) {
+					return( -1 );
+				}
+				if ( lcshutdown() ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error shutdown failed, aborting" );
+					return( -1 );
+				}
+				wlprogress.elapsed = lchist_now() - wlprogress.started;
+				wlprogress.completed = 1;
+				reportLionCloudLatency();
 				logMessage( LcSimulatorLLevel, "End of the workload file (processed)" );
 				break;
 
@@ -339,6 +556,23 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 
 		}
 
+		/* Count the operation */
+		if ( operation.op != WL_EOF ) {
+			wlprogress.operations ++;
+		}
+		if ( (operation.op == WL_READ) || (operation.op == WL_WRITE) ) {
+			wlprogress.bytes += operation.size;
+		}
+
+		/* Defragment periodically, dump the performance counters if signaled */
+		if ( (operation.op != WL_EOF) && defragLionCloud(0) ) {
+			return( -1 );
+		}
+		if ( statsrequested ) {
+			statsrequested = 0;
+			dumpLionCloudStats( statsfile );
+		}
+
 		/* Sanity check the operation state */
 		if ( operation.op > WL_EOF ) {
 			logMessage( LOG_ERROR_LEVEL, "CMPSC311 lion clound bad POST HOC op code [%d]", operation.op );
@@ -352,3 +586,577 @@ int simulateLionCloud( char *hwdef, char *wload ) {
 	closeCmpsc311Workload( &state );
 	return( 0 );
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulateLionCloudTrace
+// Description  : Replay a binary trace (see lctrace_record) against the
+//                LionCloud filesystem.  The operations and payloads are used
+//                in place from the mapped trace and the files are tracked by
+//                object index, so the harness does no parsing or lookups.
+//
+// Inputs       : hwdef - the name of hardware spec file
+//                tracefile - the name of the binary trace
+// Outputs      : 0 if successful test, -1 if failure
+
+int simulateLionCloudTrace( char *hwdef, char *tracefile ) {
+
+	/* Local types */
+	typedef struct {
+		LcFHandle 	fhandle;
+		uint32_t    pos;
+		int         isopen;
+	} fsysdata;
+
+	/* Local variables */
+	LcTrace trace;
+	const LcTraceOp *top;
+	const char *name, *data;
+	char buf[CMPSC311_MAX_OPSIZE_MAXIMUM];
+	fsysdata *files, *fdata;
+	uint32_t i;
+	LcSubmission *sq = NULL;   // batched operations (-b)
+	uint32_t *sqop = NULL;     // trace operation of each batched operation
+	int *sqres = NULL;         // results of the batched operations
+	char *sqbuf = NULL;        // read buffers of the batched operations
+	int nsq = 0;
+
+	/* Load the hardware manifest, map the trace */
+	if ( (readLionCloudHardwareManifest(hwdef)) || (lctrace_open(&trace, tracefile)) ) {
+		return( -1 );
+	}
+	if ( (files = calloc(trace.header->numnames + 1, sizeof(fsysdata))) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 lcloud trace: failed to allocate file table" );
+		lctrace_close( &trace );
+		return( -1 );
+	}
+	if ( (batchops > 0) && (((sq = calloc(batchops, sizeof(LcSubmission))) == NULL) ||
+			((sqop = calloc(batchops, sizeof(uint32_t))) == NULL) || ((sqres = calloc(batchops, sizeof(int))) == NULL) ||
+			((sqbuf = malloc((size_t)batchops * CMPSC311_MAX_OPSIZE_MAXIMUM)) == NULL)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 lcloud trace: failed to allocate the operation batch" );
+		goto failed;
+	}
+
+	/* Replay the operations */
+	logMessage( LcSimulatorLLevel, "CMPSC311 lcloud : replaying trace [%s]", tracefile );
+	memset( &wlprogress, 0x0, sizeof(wlprogress) );
+	wlprogress.started = lchist_now();
+	for ( i=0; i<trace.header->numops; i++ ) {
+
+		top = &trace.ops[i];
+		fdata = &files[top->obj];
+		name = &trace.names[top->obj * LC_TRACE_MAXNAME];
+		data = &trace.data[top->data];
+
+		switch ( top->op ) {
+
+			case WL_OPEN: /* Open the file for reading/writing, check error */
+				if ( batchops > 0 ) {
+
+					/* The open ends the batch (its handle is needed by what follows) */
+					if ( (nsq == batchops) && submitTraceBatch(&trace, sq, sqop, sqres, nsq) ) {
+						goto failed;
+					}
+					nsq = (nsq == batchops) ? 0 : nsq;
+					sq[nsq].op = LC_OP_OPEN;
+					sq[nsq].path = name;
+					sq[nsq].tag = nsq;
+					sqop[nsq++] = i;
+					if ( submitTraceBatch(&trace, sq, sqop, sqres, nsq) ) {
+						goto failed;
+					}
+					fdata->fhandle = sqres[nsq-1];
+					nsq = 0;
+				} else if ( (fdata->fhandle = lcopen(name)) == -1 ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error opening file [%s], aborting", name );
+					goto failed;
+				}
+				if ( (filecopies > 1) && lcreplicate(fdata->fhandle, filecopies) ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error mirroring file [%s], aborting", name );
+					goto failed;
+				}
+				if ( (parityunit > 0) && lcparity(fdata->fhandle, paritywidth, parityunit) ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error striping file [%s], aborting", name );
+					goto failed;
+				}
+				fdata->pos = 0;
+				fdata->isopen = 1;
+				wlprogress.opens ++;
+				break;
+
+			case WL_READ: /* Read a block of data from the file */
+			case WL_WRITE: /* Write a block of data to the file */
+				if ( ! fdata->isopen ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error %s unknown file [%s], aborting",
+						(top->op == WL_READ) ? "reading" : "writing", name );
+					goto failed;
+				}
+
+				/* Batched: queue the seek (if needed) and the transfer */
+				if ( batchops > 0 ) {
+					if ( (nsq + 2 > batchops) && submitTraceBatch(&trace, sq, sqop, sqres, nsq) ) {
+						goto failed;
+					}
+					nsq = (nsq + 2 > batchops) ? 0 : nsq;
+					if ( fdata->pos != top->pos ) {
+						sq[nsq].op = LC_OP_SEEK;
+						sq[nsq].fh = fdata->fhandle;
+						sq[nsq].len = top->pos;
+						sq[nsq].tag = nsq;
+						sqop[nsq++] = i;
+						wlprogress.seeks ++;
+					}
+					sq[nsq].op = (top->op == WL_READ) ? LC_OP_READ : LC_OP_WRITE;
+					sq[nsq].fh = fdata->fhandle;
+					sq[nsq].buf = (top->op == WL_READ) ? &sqbuf[nsq * CMPSC311_MAX_OPSIZE_MAXIMUM] : (char *)data;
+					sq[nsq].len = top->size;
+					sq[nsq].tag = nsq;
+					sqop[nsq++] = i;
+					if ( top->op == WL_READ ) {
+						wlprogress.reads ++;
+					} else {
+						wlprogress.writes ++;
+					}
+					fdata->pos = top->pos + top->size;
+					wlprogress.bytes += top->size;
+					break;
+				}
+
+				/* If the position within the file is not at the location, seek */
+				if ( fdata->pos != top->pos ) {
+					if ( lcseek(fdata->fhandle, top->pos) != top->pos ) {
+						logMessage( LOG_ERROR_LEVEL, "CMPSC311 error seek failed [%s, pos=%u], aborting",
+							name, top->pos );
+						goto failed;
+					}
+					fdata->pos = top->pos;
+					wlprogress.seeks ++;
+				}
+
+				if ( top->op == WL_READ ) {
+					if ( lcread(fdata->fhandle, buf, top->size) != top->size ) {
+						logMessage( LOG_ERROR_LEVEL, "CMPSC311 error read failed [%s, pos=%u, size=%u], aborting",
+							name, top->pos, top->size );
+						goto failed;
+					}
+					if ( memcmp(buf, data, top->size) != 0 ) {
+						logMessage( LOG_ERROR_LEVEL, "CMPSC311 read data compare failed, aborting" );
+						logMessage( LOG_ERROR_LEVEL, "Read data     : [%.20s]", buf );
+						logMessage( LOG_ERROR_LEVEL, "Expected data : [%.20s]", data );
+						goto failed;
+					}
+					wlprogress.reads ++;
+				} else {
+					if ( lcwrite(fdata->fhandle, (char *)data, top->size) != top->size ) {
+						logMessage( LOG_ERROR_LEVEL, "CMPSC311 error write failed [%s, pos=%u, size=%u], aborting",
+							name, top->pos, top->size );
+						goto failed;
+					}
+					wlprogress.writes ++;
+				}
+				fdata->pos += top->size;
+				wlprogress.bytes += top->size;
+				break;
+
+			case WL_CLOSE:
+				if ( (batchops > 0) && fdata->isopen ) {
+					if ( (nsq == batchops) && submitTraceBatch(&trace, sq, sqop, sqres, nsq) ) {
+						goto failed;
+					}
+					nsq = (nsq == batchops) ? 0 : nsq;
+					sq[nsq].op = LC_OP_CLOSE;
+					sq[nsq].fh = fdata->fhandle;
+					sq[nsq].tag = nsq;
+					sqop[nsq++] = i;
+				} else if ( (! fdata->isopen) || (lcclose(fdata->fhandle) != 0) ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error closing file [%s], aborting", name );
+					goto failed;
+				}
+				fdata->isopen = 0;
+				wlprogress.closes ++;
+				break;
+
+			default: // WL_EOF, end of the trace
+				if ( submitTraceBatch(&trace, sq, sqop, sqres, nsq) ) {
+					goto failed;
+				}
+				nsq = 0;
+				if ( check_honors_option() == 0 ) {
+					logMessage( LOG_INFO_LEVEL, "CMPSC311 - Honors options passed!" );
+				}
+				if ( defragLionCloud(1) ) {
+					goto failed;
+				}
+				if ( lcshutdown() ) {
+					logMessage( LOG_ERROR_LEVEL, "CMPSC311 error shutdown failed, aborting" );
+					goto failed;
+				}
+				wlprogress.elapsed = lchist_now() - wlprogress.started;
+				wlprogress.completed = 1;
+				reportLionCloudLatency();
+				logMessage( LcSimulatorLLevel, "End of the trace (processed)" );
+				break;
+		}
+
+		/* Count the operation, dump the performance counters if signaled */
+		if ( top->op != WL_EOF ) {
+			wlprogress.operations ++;
+			if ( defragLionCloud(0) ) {
+				goto failed;
+			}
+		}
+		if ( statsrequested ) {
+			statsrequested = 0;
+			dumpLionCloudStats( statsfile );
+		}
+	}
+
+	/* Unmap the trace, return successfully */
+	lc_cleanup_controller_system();
+	free( files );
+	free( sq );
+	free( sqop );
+	free( sqres );
+	free( sqbuf );
+	lctrace_close( &trace );
+	return( 0 );
+
+failed:
+	free( files );
+	free( sq );
+	free( sqop );
+	free( sqres );
+	free( sqbuf );
+	lctrace_close( &trace );
+	return( -1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : submitTraceBatch
+// Description  : Submit the batched trace operations (lcsubmit), reap their
+//                completions (lcpoll) and check them like the blocking calls
+//
+// Inputs       : trace - the trace being replayed
+//                sq - the batched operations (tag is the index in sq)
+//                sqop - the trace operation of each batched operation
+//                sqres - filled with the result of each batched operation
+//                nsq - number of batched operations
+// Outputs      : 0 if successful, -1 if failure
+
+int submitTraceBatch( LcTrace *trace, LcSubmission *sq, const uint32_t *sqop, int *sqres, int nsq ) {
+
+	/* Local variables */
+	static const char *oplabels[LC_OP_MAX] = { "open", "read", "write", "seek", "close" };
+	LcCompletion cqe[LC_RING_ENTRIES];
+	const LcTraceOp *top;
+	const char *name;
+	int i, n, expected;
+
+	if ( nsq == 0 ) {
+		return( 0 );
+	}
+	if ( (lcsubmit(sq, nsq) != nsq) || (lcpoll(cqe, nsq) != nsq) ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 error submitting %d batched operations, aborting", nsq );
+		return( -1 );
+	}
+
+	/* Check the completions */
+	for ( i=0; i<nsq; i++ ) {
+		n = cqe[i].tag;
+		top = &trace->ops[sqop[n]];
+		name = &trace->names[top->obj * LC_TRACE_MAXNAME];
+		sqres[n] = cqe[i].res;
+		expected = (sq[n].op == LC_OP_CLOSE) ? 0 : (int)sq[n].len;
+		if ( ((sq[n].op == LC_OP_OPEN) && (cqe[i].res <= 0)) || ((sq[n].op != LC_OP_OPEN) && (cqe[i].res != expected)) ) {
+			logMessage( LOG_ERROR_LEVEL, "CMPSC311 error %s failed [%s, pos=%u, size=%u], aborting",
+				oplabels[sq[n].op], name, top->pos, top->size );
+			return( -1 );
+		}
+		if ( (sq[n].op == LC_OP_READ) && (memcmp(sq[n].buf, &trace->data[top->data], top->size) != 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "CMPSC311 read data compare failed, aborting" );
+			logMessage( LOG_ERROR_LEVEL, "Read data     : [%.20s]", sq[n].buf );
+			logMessage( LOG_ERROR_LEVEL, "Expected data : [%.20s]", &trace->data[top->data] );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : statsSignalHandler
+// Description  : Flag a request to dump the performance counters (the dump
+//                itself happens between workload operations)
+//
+// Inputs       : sig - the signal received
+// Outputs      : none
+
+void statsSignalHandler( int sig ) {
+	statsrequested = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeJsonString
+// Description  : Write a string as a quoted JSON value, escaping quotes,
+//                backslashes and control characters
+//
+// Inputs       : fhandle - the file to write to
+//                str - the string to write
+// Outputs      : none
+
+void writeJsonString( FILE *fhandle, const char *str ) {
+
+	/* Local variables */
+	const unsigned char *p;
+
+	fputc( '"', fhandle );
+	for ( p=(const unsigned char *)str; *p; p++ ) {
+		switch ( *p ) {
+		case '"':  fputs( "\\\"", fhandle ); break;
+		case '\\': fputs( "\\\\", fhandle ); break;
+		case '\b': fputs( "\\b", fhandle ); break;
+		case '\f': fputs( "\\f", fhandle ); break;
+		case '\n': fputs( "\\n", fhandle ); break;
+		case '\r': fputs( "\\r", fhandle ); break;
+		case '\t': fputs( "\\t", fhandle ); break;
+		default:
+			if ( *p < 0x20 ) {
+				fprintf( fhandle, "\\u%04x", *p );
+			} else {
+				fputc( *p, fhandle );
+			}
+		}
+	}
+	fputc( '"', fhandle );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dumpLionCloudStats
+// Description  : Write the filesystem performance counters as JSON
+//
+// Inputs       : fname - the file to write the counters to
+// Outputs      : 0 if successful, -1 if failure
+
+int dumpLionCloudStats( const char *fname ) {
+
+	/* Local variables */
+	LcStats stats;
+	LcHistSummary hsum;
+	FILE *fhandle;
+	uint64_t accesses;
+	int i;
+
+	/* Get the counters, open the output */
+	if ( lcstats(&stats) ) {
+		return( -1 );
+	}
+	if ( (fhandle = fopen(fname, "w")) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "Failed opening stats file [%s], error [%s]", fname, strerror(errno) );
+		return( -1 );
+	}
+
+	/* Workload progress */
+	if ( ! wlprogress.completed ) {
+		wlprogress.elapsed = lchist_now() - wlprogress.started;
+	}
+	fprintf( fhandle, "{\n  \"workload\": {\n    \"status\": \"%s\",\n    \"operations\": %lu,\n"
+		"    \"bytes\": %lu,\n    \"elapsed_sec\": %0.6f,\n    \"opens\": %d,\n    \"reads\": %d,\n"
+		"    \"writes\": %d,\n    \"seeks\": %d,\n    \"closes\": %d\n  },\n",
+		(wlprogress.completed ? "completed" : (wlprogress.failed ? "failed" : "running")), wlprogress.operations, wlprogress.bytes,
+		wlprogress.elapsed/1e9, wlprogress.opens, wlprogress.reads, wlprogress.writes,
+		wlprogress.seeks, wlprogress.closes );
+
+	/* Bus transactions */
+	fprintf( fhandle, "  \"bus\": {\n    \"transactions\": %lu,\n    \"ops\": {", stats.bustransactions );
+	for ( i=0; i<LC_STATS_MAXBUSOPS; i++ ) {
+		fprintf( fhandle, "%s\"%s\": %lu", (i ? ", " : " "), LC_OPERATION_CODE_FIELD_LABLES[i], stats.busops[i] );
+	}
+	fprintf( fhandle, " }\n  },\n" );
+
+	/* Cache (the read hit rate also counts the blocks read from their delayed
+	   slot, which the small workloads are mostly served from) */
+	accesses = stats.cache.hits + stats.cache.misses;
+	fprintf( fhandle, "  \"cache\": {\n    \"hits\": %lu,\n    \"misses\": %lu,\n"
+		"    \"evictions\": %lu,\n    \"prefetches\": %lu,\n    \"inserts\": %lu,\n    \"rejected\": %lu,\n"
+		"    \"items\": %u,\n    \"maxitems\": %u,\n    \"hit_rate\": %0.4f,\n"
+		"    \"delayed_reads\": %lu,\n    \"read_hit_rate\": %0.4f,\n"
+		"    \"l2\": { \"hits\": %lu, \"misses\": %lu, \"inserts\": %lu, \"evictions\": %lu, \"items\": %u, \"maxitems\": %u },\n",
+		stats.cache.hits, stats.cache.misses, stats.cache.evictions, stats.cache.prefetches,
+		stats.cache.inserts, stats.cache.rejected, stats.cache.items, stats.cache.maxitems,
+		(accesses == 0) ? 0.0 : (double)stats.cache.hits/(double)accesses, stats.delayedreads,
+		(accesses + stats.delayedreads == 0) ? 0.0 :
+			(double)(stats.cache.hits + stats.delayedreads)/(double)(accesses + stats.delayedreads),
+		stats.cache.l2hits, stats.cache.l2misses, stats.cache.l2inserts, stats.cache.l2evictions,
+		stats.cache.l2items, stats.cache.l2maxitems );
+
+	/* Compressed tier: effective capacity (blocks at the current ratio) and CPU cost */
+	fprintf( fhandle, "    \"compressed\": { \"hits\": %lu, \"inserts\": %lu, \"evictions\": %lu, \"items\": %u,"
+		" \"stored_bytes\": %u, \"capacity_bytes\": %u, \"ratio\": %0.2f, \"effective_blocks\": %0.0f,"
+		" \"compress_ns\": %0.1f, \"decompress_ns\": %0.1f }\n  },\n",
+		stats.cache.zhits, stats.cache.zinserts, stats.cache.zevictions, stats.cache.zitems,
+		stats.cache.zstored, stats.cache.zcapacity,
+		(stats.cache.zstored == 0) ? 0.0 : (double)stats.cache.zitems*LC_DEVICE_BLOCK_SIZE/stats.cache.zstored,
+		(stats.cache.zstored == 0) ? 0.0 : (double)stats.cache.zcapacity*stats.cache.zitems/stats.cache.zstored,
+		(stats.cache.zinserts == 0) ? 0.0 : (double)stats.cache.zcompressns/stats.cache.zinserts,
+		(stats.cache.zhits == 0) ? 0.0 : (double)stats.cache.zdecompressns/stats.cache.zhits );
+
+	/* I/O scheduler */
+	fprintf( fhandle, "  \"scheduler\": {\n    \"policy\": \"%s\",\n    \"queued\": %lu,\n    \"dispatched\": %lu,\n"
+		"    \"merges\": %lu,\n    \"superseded\": %lu,\n    \"forwarded\": %lu,\n    \"reorders\": %lu,\n"
+		"    \"expired\": %lu,\n    \"retried\": %lu,\n    \"max_depth\": %u\n  },\n",
+		LC_SCHED_POLICY_LABELS[stats.sched.policy], stats.sched.queued, stats.sched.dispatched,
+		stats.sched.merges, stats.sched.superseded, stats.sched.forwarded, stats.sched.reorders,
+		stats.sched.expired, stats.sched.retried, stats.sched.maxdepth );
+
+	/* Allocation */
+	fprintf( fhandle, "  \"allocation\": {\n    \"placement\": \"%s\",\n    \"allocated\": %lu,\n    \"freed\": %lu,\n    \"runs\": %lu,\n"
+		"    \"total\": %lu,\n    \"hole_reads\": %lu,\n    \"zero_holes\": %lu,\n    \"cluster_blocks\": %u,\n"
+		"    \"cluster_allocs\": %lu,\n    \"cluster_hits\": %lu,\n    \"cluster_reads\": %lu,\n    \"cluster_reserved\": %u\n  },\n",
+		LC_PLACE_POLICY_LABELS[stats.placement], stats.allocations, stats.frees, stats.allocruns, stats.totalblocks,
+		stats.holereads, stats.zeroholes, stats.clusterblocks, stats.clusterallocs, stats.clusterhits, stats.clusterreads,
+		stats.clusterreserved );
+
+	/* Deduplication */
+	fprintf( fhandle, "  \"dedup\": {\n    \"enabled\": %s,\n    \"lookups\": %lu,\n    \"hits\": %lu,\n"
+		"    \"collisions\": %lu,\n    \"releases\": %lu,\n    \"unshares\": %lu,\n    \"entries\": %u,\n"
+		"    \"shared\": %u\n  },\n", (stats.dedup.enabled ? "true" : "false"), stats.dedup.lookups,
+		stats.dedup.hits, stats.dedup.collisions, stats.dedup.releases, stats.dedup.unshares,
+		stats.dedup.entries, stats.dedup.shared );
+
+	/* Defragmentation */
+	fprintf( fhandle, "  \"defrag\": {\n    \"passes\": %lu,\n    \"moved\": %lu,\n    \"blocks\": %lu,\n"
+		"    \"extents_before\": %lu,\n    \"extents_after\": %lu\n  },\n", stats.defragpasses, stats.defragmoved,
+		fragafter.blocks, fragbefore.extents, fragafter.extents );
+
+	/* Replication */
+	fprintf( fhandle, "  \"replication\": {\n    \"copies\": %d,\n    \"replica_writes\": %lu,\n"
+		"    \"replica_reads\": %lu,\n    \"failovers\": %lu\n  },\n", filecopies, stats.mirrorwrites,
+		stats.mirrorreads, stats.failovers );
+	fprintf( fhandle, "  \"parity\": {\n    \"unit\": %d,\n    \"width\": %d,\n    \"kernel\": \"%s\",\n"
+		"    \"full_rows\": %lu,\n    \"partial_rows\": %lu,\n    \"parity_writes\": %lu,\n"
+		"    \"degraded_reads\": %lu\n  },\n", parityunit, paritywidth, lcparity_kernel(),
+		stats.parityfull, stats.paritypartial, stats.paritywrites, stats.degradedreads );
+
+	/* Inline files */
+	fprintf( fhandle, "  \"inline\": {\n    \"max_bytes\": %u,\n    \"files\": %u,\n    \"reads\": %lu,\n"
+		"    \"writes\": %lu,\n    \"promotions\": %lu\n  },\n", stats.inlinemax, stats.inlinefiles,
+		stats.inlinereads, stats.inlinewrites, stats.inlinepromotions );
+
+	/* Tail packing */
+	fprintf( fhandle, "  \"tailpack\": {\n    \"enabled\": %u,\n    \"packed\": %lu,\n    \"unpacked\": %lu,\n"
+		"    \"reads\": %lu,\n    \"pack_blocks\": %u,\n    \"packed_bytes\": %u\n  },\n", stats.tailpack,
+		stats.packedtails, stats.unpackedtails, stats.packreads, stats.packblocks, stats.packbytes );
+
+	/* Batched submission */
+	fprintf( fhandle, "  \"submit\": {\n    \"batch\": %d,\n    \"submits\": %lu,\n    \"operations\": %lu,\n"
+		"    \"read_runs\": %lu,\n    \"batched_reads\": %lu\n  },\n", batchops, stats.submits, stats.submitted,
+		stats.batchruns, stats.batchedreads );
+
+	/* Devices */
+	fprintf( fhandle, "  \"devices\": [" );
+	for ( i=0; i<stats.numdevices; i++ ) {
+		fprintf( fhandle, "%s\n    { \"did\": %u, \"sectors\": %u, \"blocks\": %u, \"allocated\": %lu, \"free\": %u, \"errors\": %lu, "
+			"\"reads\": %lu, \"writes\": %lu, \"bytes_read\": %lu, \"bytes_written\": %lu }",
+			(i ? "," : ""), stats.devices[i].did, stats.devices[i].maxsec, stats.devices[i].maxblk,
+			stats.devices[i].allocated, stats.devices[i].free, stats.devices[i].errors, stats.devices[i].reads, stats.devices[i].writes,
+			stats.devices[i].bytesread, stats.devices[i].byteswritten );
+	}
+	fprintf( fhandle, "\n  ],\n" );
+
+	/* Latency percentiles (ns) */
+	fprintf( fhandle, "  \"latency_ns\": {" );
+	for ( i=0; i<LC_HIST_MAX; i++ ) {
+		lchist_summary( i, &hsum );
+		fprintf( fhandle, "%s\n    \"%s\": { \"count\": %lu, \"min\": %lu, \"mean\": %0.1f, \"p50\": %lu, "
+			"\"p90\": %lu, \"p99\": %lu, \"p99.9\": %lu, \"max\": %lu }", (i ? "," : ""), LC_HIST_LABELS[i],
+			hsum.count, hsum.min, hsum.mean, hsum.p50, hsum.p90, hsum.p99, hsum.p999, hsum.max );
+	}
+	fprintf( fhandle, "\n  },\n" );
+
+	/* Files (skip unused handles) */
+	fprintf( fhandle, "  \"files\": [" );
+	for ( i=0, accesses=0; i<stats.numfiles; i++ ) {
+		if ( stats.files[i].opens == 0 ) {
+			continue;
+		}
+		fprintf( fhandle, "%s\n    { \"fh\": %d, \"name\": ", (accesses++ ? "," : ""), stats.files[i].fh );
+		writeJsonString( fhandle, stats.files[i].name );
+		fprintf( fhandle, ", \"opens\": %lu, \"reads\": %lu, "
+			"\"writes\": %lu, \"seeks\": %lu, \"bytes_read\": %lu, \"bytes_written\": %lu, "
+			"\"tail_writes\": %lu, \"tail_flushes\": %lu }", stats.files[i].opens,
+			stats.files[i].reads, stats.files[i].writes, stats.files[i].seeks,
+			stats.files[i].bytesread, stats.files[i].byteswritten, stats.files[i].tailwrites,
+			stats.files[i].tailflushes );
+	}
+	fprintf( fhandle, "\n  ]\n}\n" );
+
+	/* Close the file, return successfully */
+	fclose( fhandle );
+	logMessage( LcSimulatorLLevel, "Wrote performance counters to [%s]", fname );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : defragLionCloud
+// Description  : Run an lcdefrag pass over every file when the -d interval
+//                of operations is reached (or at the end of the workload)
+//
+// Inputs       : final - the workload is done (run the closing pass)
+// Outputs      : 0 if successful, -1 if failure
+
+int defragLionCloud( int final ) {
+
+	/* Local variables */
+	LcFragReport before;
+
+	/* Is a pass due? */
+	if ( (defraginterval < 0) || ((! final) && ((defraginterval == 0) ||
+			(wlprogress.operations % defraginterval != 0))) ) {
+		return( 0 );
+	}
+
+	/* Defragment, keep the first before and the last after report */
+	if ( lcdefrag(LC_DEFRAG_ALL, &before, &fragafter) ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 defragmentation failed after %lu operations", wlprogress.operations );
+		return( -1 );
+	}
+	if ( fragbefore.blocks == 0 ) {
+		fragbefore = before;
+	}
+	logMessage( LcSimulatorLLevel, "Defragmented after %lu operations: %lu blocks, %lu extents -> %lu extents, %lu moved",
+		wlprogress.operations, fragafter.blocks, before.extents, fragafter.extents, fragafter.moved );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : reportLionCloudLatency
+// Description  : Log the latency percentiles of the bus, cache and filesystem
+//                calls recorded during the workload
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int reportLionCloudLatency( void ) {
+
+	/* Local variables */
+	LcHistSummary hsum;
+	int i;
+
+	logMessage( LOG_OUTPUT_LEVEL, "LionCloud latency (usec) %16s %10s %10s %10s %10s %10s %10s",
+		"operation", "count", "p50", "p90", "p99", "p99.9", "max" );
+	for ( i=0; i<LC_HIST_MAX; i++ ) {
+		if ( (lchist_summary(i, &hsum) == 0) && (hsum.count > 0) ) {
+			logMessage( LOG_OUTPUT_LEVEL, "LionCloud latency (usec) %16s %10lu %10.2f %10.2f %10.2f %10.2f %10.2f",
+				LC_HIST_LABELS[i], hsum.count, hsum.p50/1000.0, hsum.p90/1000.0, hsum.p99/1000.0,
+				hsum.p999/1000.0, hsum.max/1000.0 );
+		}
+	}
+
+	/* Return successfully */
+	return( 0 );
+}
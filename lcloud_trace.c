@@ -0,0 +1,390 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_trace.c
+//  Description    : This is the binary workload trace implementation for the
+//                   LionCloud simulator.  Recording parses the text workload
+//                   once, interning object names and storing each distinct
+//                   data payload only once; replay maps the trace read-only
+//                   and hands the operations out in place.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cmpsc311_log.h>
+#include <lcloud_trace.h>
+
+// Defines
+#define TRACE_NAMEHASH (2 * WL_MAX_OBJS)   // object name hash slots
+#define TRACE_ALIGN(x) (((x) + 7) & ~(uint64_t)7)
+
+// payload dedup hash entry
+typedef struct {
+    uint64_t hash;       // payload hash (0 = empty slot)
+    uint64_t off;        // offset in the payload area
+    uint32_t size;       // payload size
+}payloadent;
+
+// trace under construction
+typedef struct {
+    char       *names;       // object name table
+    uint32_t    numnames;
+    int32_t     namehash[TRACE_NAMEHASH];  // name index + 1, 0 = empty
+    LcTraceOp  *ops;         // operations
+    uint32_t    numops, maxops;
+    char       *data;        // payload area
+    uint64_t    datasize, maxdata;
+    payloadent *payloads;    // payload dedup table
+    uint64_t    numpayloads, maxpayloads;
+}tracebuild;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : trace_hash
+// Description  : FNV-1a hash of a buffer (never returns 0)
+//
+// Inputs       : buf - the bytes to hash
+//                len - the number of bytes
+// Outputs      : the hash
+
+static uint64_t trace_hash(const char *buf, size_t len){
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for(i=0; i<len; i++){
+        h = (h ^ (uint8_t)buf[i]) * 0x100000001b3ULL;
+    }
+    return (h == 0) ? 1 : h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : trace_name
+// Description  : find (interning on first use) the index of an object name
+//
+// Inputs       : tb - the trace being built
+//                name - the object name
+// Outputs      : name index, -1 if failure
+
+static int trace_name(tracebuild *tb, const char *name){
+    uint32_t slot = trace_hash(name, strlen(name)) % TRACE_NAMEHASH;
+
+    while(tb->namehash[slot] != 0){
+        if(strncmp(&tb->names[(tb->namehash[slot]-1) * LC_TRACE_MAXNAME], name, LC_TRACE_MAXNAME) == 0){
+            return tb->namehash[slot] - 1;
+        }
+        slot = (slot + 1) % TRACE_NAMEHASH;
+    }
+    if(tb->numnames >= WL_MAX_OBJS || strlen(name) >= LC_TRACE_MAXNAME){
+        logMessage(LOG_ERROR_LEVEL, "Trace: too many objects or name too long [%s]", name);
+        return -1;
+    }
+    if((tb->names = realloc(tb->names, (tb->numnames+1) * LC_TRACE_MAXNAME)) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Trace: failed to allocate name table");
+        return -1;
+    }
+    memset(&tb->names[tb->numnames * LC_TRACE_MAXNAME], 0x0, LC_TRACE_MAXNAME);
+    strcpy(&tb->names[tb->numnames * LC_TRACE_MAXNAME], name);
+    tb->namehash[slot] = ++tb->numnames;
+    return tb->numnames - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : trace_payload
+// Description  : find (storing on first use) the offset of a data payload
+//
+// Inputs       : tb - the trace being built
+//                buf - the payload
+//                len - payload size
+//                off - (out) offset in the payload area
+// Outputs      : 0 if successful, -1 if failure
+
+static int trace_payload(tracebuild *tb, const char *buf, uint32_t len, uint64_t *off){
+    payloadent *old;
+    uint64_t h = trace_hash(buf, len), slot, i, oldmax;
+
+    // grow (and rehash) the dedup table at half full
+    if(tb->numpayloads * 2 >= tb->maxpayloads){
+        old = tb->payloads;
+        oldmax = tb->maxpayloads;
+        tb->maxpayloads = (oldmax == 0) ? 4096 : oldmax * 2;
+        if((tb->payloads = calloc(tb->maxpayloads, sizeof(payloadent))) == NULL){
+            logMessage(LOG_ERROR_LEVEL, "Trace: failed to allocate payload table");
+            return -1;
+        }
+        for(i=0; i<oldmax; i++){
+            if(old[i].hash != 0){
+                slot = old[i].hash % tb->maxpayloads;
+                while(tb->payloads[slot].hash != 0){
+                    slot = (slot + 1) % tb->maxpayloads;
+                }
+                tb->payloads[slot] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    // look for an identical payload
+    slot = h % tb->maxpayloads;
+    while(tb->payloads[slot].hash != 0){
+        if(tb->payloads[slot].hash == h && tb->payloads[slot].size == len &&
+                memcmp(&tb->data[tb->payloads[slot].off], buf, len) == 0){
+            *off = tb->payloads[slot].off;
+            return 0;
+        }
+        slot = (slot + 1) % tb->maxpayloads;
+    }
+
+    // new payload, append it
+    if(tb->datasize + len > tb->maxdata){
+        tb->maxdata = (tb->maxdata == 0) ? 1024*1024 : tb->maxdata * 2;
+        if(tb->maxdata < tb->datasize + len){
+            tb->maxdata = tb->datasize + len;
+        }
+        if((tb->data = realloc(tb->data, tb->maxdata)) == NULL){
+            logMessage(LOG_ERROR_LEVEL, "Trace: failed to allocate payload area");
+            return -1;
+        }
+    }
+    memcpy(&tb->data[tb->datasize], buf, len);
+    tb->payloads[slot].hash = h;
+    tb->payloads[slot].off = tb->datasize;
+    tb->payloads[slot].size = len;
+    tb->numpayloads++;
+    *off = tb->datasize;
+    tb->datasize += len;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : trace_write
+// Description  : write the built trace out to a file
+//
+// Inputs       : tb - the trace being built
+//                tracefile - the output file
+// Outputs      : 0 if successful, -1 if failure
+
+static int trace_write(tracebuild *tb, const char *tracefile){
+    LcTraceHeader hdr;
+    FILE *fhandle;
+    int ret = 0;
+
+    memset(&hdr, 0x0, sizeof(hdr));
+    memcpy(hdr.magic, LC_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = LC_TRACE_VERSION;
+    hdr.numops = tb->numops;
+    hdr.numnames = tb->numnames;
+    hdr.nameoff = TRACE_ALIGN(sizeof(hdr));
+    hdr.opoff = TRACE_ALIGN(hdr.nameoff + (uint64_t)tb->numnames * LC_TRACE_MAXNAME);
+    hdr.dataoff = TRACE_ALIGN(hdr.opoff + (uint64_t)tb->numops * sizeof(LcTraceOp));
+    hdr.datasize = tb->datasize;
+
+    if((fhandle = fopen(tracefile, "w")) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Trace: failed opening [%s], error [%s]", tracefile, strerror(errno));
+        return -1;
+    }
+    if(fwrite(&hdr, sizeof(hdr), 1, fhandle) != 1 ||
+            fwrite(tb->names, LC_TRACE_MAXNAME, tb->numnames, fhandle) != tb->numnames ||
+            fwrite(tb->ops, sizeof(LcTraceOp), tb->numops, fhandle) != tb->numops ||
+            fwrite(tb->data, 1, tb->datasize, fhandle) != tb->datasize){
+        logMessage(LOG_ERROR_LEVEL, "Trace: failed writing [%s], error [%s]", tracefile, strerror(errno));
+        ret = -1;
+    }
+    if(fclose(fhandle) != 0){
+        ret = -1;
+    }
+    return ret;
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lctrace_record
+// Description  : Convert a text workload into a binary trace
+//
+// Inputs       : wload - the text workload file
+//                tracefile - the trace file to write
+// Outputs      : 0 if successful, -1 if failure
+
+int lctrace_record( const char *wload, const char *tracefile ) {
+    workload_state state;
+    workload_operation *operation;
+    tracebuild *tb;
+    LcTraceOp *top;
+    int obj, ret = -1;
+
+    if((operation = malloc(sizeof(workload_operation))) == NULL ||
+            (tb = calloc(1, sizeof(tracebuild))) == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Trace: failed to allocate recording state");
+        free(operation);
+        return( -1 );
+    }
+    if(openCmpsc311Workload(&state, wload)){
+        logMessage(LOG_ERROR_LEVEL, "Trace: failed opening workload [%s]", wload);
+        free(operation);
+        free(tb);
+        return( -1 );
+    }
+
+    // parse every operation once
+    do{
+        if(readCmpsc311Workload(&state, operation)){
+            logMessage(LOG_ERROR_LEVEL, "Trace: workload read failed at line %d", state.lineno);
+            goto done;
+        }
+        if(operation->op > WL_EOF || ((operation->op == WL_READ || operation->op == WL_WRITE) &&
+                (operation->pos > UINT32_MAX || operation->size > CMPSC311_MAX_OPSIZE_MAXIMUM))){
+            logMessage(LOG_ERROR_LEVEL, "Trace: bad operation at line %d", state.lineno);
+            goto done;
+        }
+        if(tb->numops == tb->maxops){
+            tb->maxops = (tb->maxops == 0) ? 4096 : tb->maxops * 2;
+            if((tb->ops = realloc(tb->ops, tb->maxops * sizeof(LcTraceOp))) == NULL){
+                logMessage(LOG_ERROR_LEVEL, "Trace: failed to allocate operations");
+                goto done;
+            }
+        }
+        top = &tb->ops[tb->numops];
+        memset(top, 0x0, sizeof(LcTraceOp));
+        top->op = operation->op;
+        if(operation->op != WL_EOF){
+            if((obj = trace_name(tb, operation->objname)) == -1){
+                goto done;
+            }
+            top->obj = obj;
+        }
+        if(operation->op == WL_READ || operation->op == WL_WRITE){
+            top->pos = operation->pos;
+            top->size = operation->size;
+            if(trace_payload(tb, operation->data, operation->size, &top->data)){
+                goto done;
+            }
+        }
+        tb->numops++;
+    }while(operation->op < WL_EOF);
+
+    ret = trace_write(tb, tracefile);
+    if(ret == 0){
+        logMessage(LOG_INFO_LEVEL, "Trace: recorded [%s] to [%s], %u ops, %u objects, %lu payload bytes",
+            wload, tracefile, tb->numops, tb->numnames, tb->datasize);
+    }
+
+done:
+    closeCmpsc311Workload(&state);
+    free(tb->names);
+    free(tb->ops);
+    free(tb->data);
+    free(tb->payloads);
+    free(tb);
+    free(operation);
+    return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lctrace_open
+// Description  : Map and validate a binary trace for replay (the operations
+//                are checked once here so replay can use them unchecked)
+//
+// Inputs       : trace - the trace structure to fill
+//                tracefile - the trace file
+// Outputs      : 0 if successful, -1 if failure
+
+int lctrace_open( LcTrace *trace, const char *tracefile ) {
+    const LcTraceHeader *hdr;
+    const LcTraceOp *top;
+    struct stat st;
+    uint32_t i;
+    int fd;
+
+    memset(trace, 0x0, sizeof(LcTrace));
+    if((fd = open(tracefile, O_RDONLY)) == -1 || fstat(fd, &st) == -1){
+        logMessage(LOG_ERROR_LEVEL, "Trace: failed opening [%s], error [%s]", tracefile, strerror(errno));
+        if(fd != -1){
+            close(fd);
+        }
+        return( -1 );
+    }
+    if(st.st_size < sizeof(LcTraceHeader)){
+        logMessage(LOG_ERROR_LEVEL, "Trace: [%s] is not a trace", tracefile);
+        close(fd);
+        return( -1 );
+    }
+    trace->length = st.st_size;
+    trace->base = mmap(NULL, trace->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(trace->base == MAP_FAILED){
+        logMessage(LOG_ERROR_LEVEL, "Trace: failed mapping [%s], error [%s]", tracefile, strerror(errno));
+        trace->base = NULL;
+        return( -1 );
+    }
+    madvise(trace->base, trace->length, MADV_WILLNEED);
+
+    // check the header and section bounds
+    hdr = trace->header = trace->base;
+    if(memcmp(hdr->magic, LC_TRACE_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != LC_TRACE_VERSION ||
+            hdr->numops == 0 || hdr->nameoff % 8 || hdr->opoff % 8 ||
+            hdr->nameoff + (uint64_t)hdr->numnames * LC_TRACE_MAXNAME > trace->length ||
+            hdr->opoff + (uint64_t)hdr->numops * sizeof(LcTraceOp) > trace->length ||
+            hdr->dataoff + hdr->datasize > trace->length){
+        logMessage(LOG_ERROR_LEVEL, "Trace: [%s] is not a valid version %d trace", tracefile, LC_TRACE_VERSION);
+        lctrace_close(trace);
+        return( -1 );
+    }
+    trace->names = (const char *)trace->base + hdr->nameoff;
+    trace->ops = (const LcTraceOp *)((const char *)trace->base + hdr->opoff);
+    trace->data = (const char *)trace->base + hdr->dataoff;
+
+    // check the operations
+    for(i=0; i<hdr->numops; i++){
+        top = &trace->ops[i];
+        if(top->op > WL_EOF || (top->op != WL_EOF && top->obj >= hdr->numnames) ||
+                top->size > CMPSC311_MAX_OPSIZE_MAXIMUM || top->data + top->size > hdr->datasize ||
+                (top->op == WL_EOF) != (i == hdr->numops-1)){
+            logMessage(LOG_ERROR_LEVEL, "Trace: [%s] has a bad operation at %u", tracefile, i);
+            lctrace_close(trace);
+            return( -1 );
+        }
+    }
+    for(i=0; i<hdr->numnames; i++){
+        if(trace->names[i*LC_TRACE_MAXNAME + LC_TRACE_MAXNAME-1] != 0){
+            logMessage(LOG_ERROR_LEVEL, "Trace: [%s] has a bad object name %u", tracefile, i);
+            lctrace_close(trace);
+            return( -1 );
+        }
+    }
+
+    /* Return successfully */
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lctrace_close
+// Description  : Unmap a trace
+//
+// Inputs       : trace - the trace to unmap
+// Outputs      : 0 if successful, -1 if failure
+
+int lctrace_close( LcTrace *trace ) {
+    if(trace->base != NULL){
+        munmap(trace->base, trace->length);
+    }
+    memset(trace, 0x0, sizeof(LcTrace));
+    return( 0 );
+}
@@ -0,0 +1,78 @@
+#ifndef LCLOUD_TRACE_INCLUDED
+#define LCLOUD_TRACE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_trace.h
+//  Description    : This is the binary workload trace API for the LionCloud
+//                   simulator.  A text workload is recorded once into a
+//                   compact, memory-mappable trace (object names, fixed size
+//                   operations, deduplicated data payloads) that can then be
+//                   replayed without any parsing.
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Includes
+#include <stdint.h>
+#include <stddef.h>
+#include <cmpsc311_workload.h>
+
+// Defines
+#define LC_TRACE_MAGIC "LCTRACE1"      // first 8 bytes of every trace
+#define LC_TRACE_VERSION 1
+#define LC_TRACE_MAXNAME 128           // fixed size object name slots
+
+//
+// Trace layout (all offsets from the start of the file, 8 byte aligned):
+//
+//   LcTraceHeader | names[numnames][LC_TRACE_MAXNAME] | LcTraceOp[numops] | data
+//
+
+// The trace file header
+typedef struct {
+    char     magic[8];     // LC_TRACE_MAGIC
+    uint32_t version;      // LC_TRACE_VERSION
+    uint32_t numops;       // number of operations (the last is WL_EOF)
+    uint32_t numnames;     // number of object names
+    uint32_t reserved;
+    uint64_t nameoff;      // offset of the object name table
+    uint64_t opoff;        // offset of the operations
+    uint64_t dataoff;      // offset of the data payloads
+    uint64_t datasize;     // size of the data payloads
+} LcTraceHeader;
+
+// A single trace operation
+typedef struct {
+    uint64_t data;         // payload offset (relative to dataoff)
+    uint32_t pos;          // position in the object
+    uint32_t size;         // size of the read/write
+    uint16_t obj;          // object name index
+    uint8_t  op;           // workload_operations_type
+    uint8_t  pad[5];
+} LcTraceOp;
+
+// A trace mapped for replay
+typedef struct {
+    void                *base;      // the mapping
+    size_t               length;    // mapping length
+    const LcTraceHeader *header;
+    const char          *names;     // numnames x LC_TRACE_MAXNAME
+    const LcTraceOp     *ops;
+    const char          *data;
+} LcTrace;
+
+//
+// Functional Prototypes
+
+int lctrace_record( const char *wload, const char *tracefile );
+    // Convert a text workload into a binary trace
+
+int lctrace_open( LcTrace *trace, const char *tracefile );
+    // Map and validate a binary trace for replay
+
+int lctrace_close( LcTrace *trace );
+    // Unmap a trace
+
+#endif
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : lcloud_wlgen.c
+//  Description    : This is a small driver that generates LionCloud workload
+//                   files from workload specifications (used by the
+//                   benchmark suite).
+//
+//   Author        : Sung Woo Oh
+//   Last Modified : Mon 19 Oct 2026 09:00:00 AM EDT
+//
+
+// Include Files
+#include <stdio.h>
+#include <unistd.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_workload.h>
+
+// Defines
+#define LCLOUD_WLGEN_ARGUMENTS "hv"
+#define USAGE \
+	"USAGE: lcloud_wlgen [-h] [-v] <workload-spec>...\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - verbose output\n" \
+	"\n" \
+	"    <workload-spec> - workload specification file (WORKLOAD, WORKLOAD-PARAM,\n" \
+	"                      OBJECTS, WORKLOAD-OUTPUT, GENERATE sections)\n" \
+	"\n" \
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the workload generator
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, verbose = 0, i;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, LCLOUD_WLGEN_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // Verbose Flag
+			verbose = 1;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	// Setup the log
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	if ( verbose ) {
+		enableLogLevels( LOG_INFO_LEVEL );
+	}
+	if ( optind >= argc ) {
+		fprintf( stderr, "Missing workload specification, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Generate each of the workloads
+	for ( i=optind; i<argc; i++ ) {
+		if ( createCmpsc311Workload(argv[i]) ) {
+			logMessage( LOG_ERROR_LEVEL, "Failed generating workload from [%s], aborting.", argv[i] );
+			return( -1 );
+		}
+		logMessage( LOG_INFO_LEVEL, "Generated workload from [%s]", argv[i] );
+	}
+
+	// Return successfully
+	return( 0 );
+}